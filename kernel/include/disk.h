@@ -15,5 +15,7 @@ void copy_to_disk(const void *buf, int nbytes, int disk_offset);
 void bread(void *dst, uint32_t size, uint32_t no, uint32_t off);
 void bwrite(const void *src, uint32_t size, uint32_t no, uint32_t off);
 void bzero(uint32_t no);
+void bread_direct(void *dst, uint32_t no);
+void bwrite_direct(const void *src, uint32_t no);
 
 #endif
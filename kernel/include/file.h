@@ -13,6 +13,7 @@ typedef struct file {
   // for normal file
   inode_t *inode;
   uint32_t offset;
+  int direct; // opened with O_DIRECT
 
   // for dev file
   dev_t *dev_op;
@@ -21,6 +22,9 @@ typedef struct file {
 file_t *fopen(const char *path, int mode);
 int fread(file_t *file, void *buf, uint32_t size);
 int fwrite(file_t *file, const void *buf, uint32_t size);
+int fsendfile(file_t *out, file_t *in, uint32_t size);
+int freadv(file_t *file, const struct iovec *iov, int iovcnt);
+int fwritev(file_t *file, const struct iovec *iov, int iovcnt);
 uint32_t fseek(file_t *file, uint32_t off, int whence);
 file_t *fdup(file_t *file);
 void fclose(file_t *file);
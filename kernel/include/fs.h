@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 typedef struct inode inode_t;
+struct dirent_stat;
 
 #define EASY_FS // TODO: comment me at Lab3-2
 
@@ -12,15 +13,19 @@ void init_fs();
 inode_t *iopen(const char *path, int type);
 int iread(inode_t *inode, uint32_t off, void *buf, uint32_t len);
 int iwrite(inode_t *inode, uint32_t off, const void *buf, uint32_t len);
+int iread_direct(inode_t *inode, uint32_t off, void *buf, uint32_t len);
+int iwrite_direct(inode_t *inode, uint32_t off, const void *buf, uint32_t len);
 void itrunc(inode_t *inode);
 inode_t *idup(inode_t *inode);
 void iclose(inode_t *inode);
 uint32_t isize(inode_t *inode);
 int itype(inode_t *inode);
 uint32_t ino(inode_t *inode);
+uint32_t iversion(inode_t *inode);
 int idevid(inode_t *inode);
 void iadddev(const char *name, int id);
 int iremove(const char *path);
+int igetdents(inode_t *dir, uint32_t *off, struct dirent_stat *de, int count, int flags);
 
 #ifdef EASY_FS
 
@@ -0,0 +1,11 @@
+#ifndef __KSM_H__
+#define __KSM_H__
+
+#include "klib.h"
+
+#define KSM_BATCH 16 // pages scanned by idle loop once
+
+void ksm_scan(int npage);
+uint32_t ksm_saved();
+
+#endif
@@ -3,9 +3,9 @@
 
 #include <stdint.h>
 
-uint32_t load_elf(struct PageDirectory *pgdir, const char *name);
+uint32_t load_elf(struct PageDirectory *pgdir, struct vma *vmas, const char *name);
 uint32_t load_arg(struct PageDirectory *pgdir, char *const argv[]);
-int load_user(struct PageDirectory *pgdir, struct Context *ctx, 
+int load_user(struct PageDirectory *pgdir, struct vma *vmas, struct Context *ctx,
               const char *name, char *const argv[]);
 
 #endif
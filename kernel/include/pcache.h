@@ -0,0 +1,13 @@
+#ifndef __PCACHE_H__
+#define __PCACHE_H__
+
+#include "klib.h"
+#include "fs.h"
+
+void *pcache_get(inode_t *inode, uint32_t pgno);
+void *pcache_get_shared(inode_t *inode, uint32_t pgno);
+int pcache_read(inode_t *inode, uint32_t off, void *buf, uint32_t len);
+void pcache_write(inode_t *inode, uint32_t off, const void *buf, uint32_t len);
+void pcache_drop(inode_t *inode);
+
+#endif
@@ -20,12 +20,14 @@ typedef union {
 #define STACK_TOP(kstack) (&((kstack)->stack[KSTACK_SIZE]))
 #define MAX_USEM 32
 #define MAX_UFILE 32
+#define NR_PRIO 8 // levels of MLFQ, 0 is the highest
 
 typedef struct proc {
   int pid;
   enum {UNUSED, UNINIT, RUNNING, READY, ZOMBIE, BLOCKED} status;
   PD *pgdir;
   size_t brk;
+  vma_t vmas[MAX_VMA]; // user memory mapped on demand
   kstack_t *kstack;
   Context *ctx; // points to restore context for READY proc
   struct proc *parent; // Lab2-2
@@ -35,19 +37,44 @@ typedef struct proc {
   usem_t *usems[MAX_USEM]; // Lab2-5
   file_t *files[MAX_UFILE]; // Lab3-1
   //inode_t *cwd; // Lab3-2
+  struct proc *prev, *next; // in the list of all procs
+  int prio, nice; // level in MLFQ, and the top level it can have
+  uint32_t ticks; // ticks used in its quantum
+  struct proc *rq_next; // in the ready queue of its level
+  // real-time class if rt_period != 0, run by EDF ahead of MLFQ
+  uint32_t rt_period, rt_runtime, rt_deadline; // deadline is relative to release
+  uint32_t rt_start, rt_used; // release tick and ticks used of current job
+  uint32_t rt_finish; // tick current job is done, 0 if not yet
+  uint32_t rt_jobs, rt_miss;
+  struct proc *rt_next; // in the list of real-time procs
+  // blocked with a timeout, in the timer wheel slot of its expire tick
+  uint32_t tw_expire;
+  struct proc *tw_next, **tw_pprev; // tw_pprev is NULL if not in the wheel
+  sem_t *wait_sem; // sem it waits in with a timeout, left when timed out
+  list_t *wait_entry;
+  int timedout; // woken by the timer, not by whom it waits for
 } proc_t;
 
 void init_proc();
 proc_t *proc_alloc();
 void proc_free(proc_t *proc);
 proc_t *proc_curr();
+void proc_cr3info(uint32_t *load, uint32_t *skip);
+proc_t *proc_find(int pid);
+proc_t *proc_next(proc_t *proc);
 void proc_run(proc_t *proc) __attribute__((noreturn));
 void proc_addready(proc_t *proc);
 void proc_yield();
-void proc_copycurr(proc_t *proc);
+void proc_tick();
+int proc_nice(int inc);
+int proc_setrt(uint32_t period, uint32_t runtime, uint32_t deadline);
+int proc_copycurr(proc_t *proc);
+void proc_inherit(proc_t *proc);
+void proc_release(proc_t *proc);
 void proc_makezombie(proc_t *proc, int exitcode);
 proc_t *proc_findzombie(proc_t *proc);
 void proc_block();
+int proc_timedblock(uint32_t ticks);
 int proc_allocusem(proc_t *proc);
 usem_t *proc_getusem(proc_t *proc, int sem_id);
 int proc_allocfile(proc_t *proc);
@@ -11,6 +11,8 @@ typedef struct sem {
 void sem_init(sem_t *sem, int value);
 void sem_p(sem_t *sem);
 void sem_v(sem_t *sem);
+int sem_p_timeout(sem_t *sem, uint32_t ticks);
+void sem_cancel(sem_t *sem, list_t *entry);
 
 typedef struct usem {
   sem_t sem;
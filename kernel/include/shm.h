@@ -0,0 +1,23 @@
+#ifndef __SHM_H__
+#define __SHM_H__
+
+#include "klib.h"
+
+#define SHM_NAME  15 // max length of segment name
+#define SHM_MAXPG (PGSIZE / sizeof(void*)) // a segment is 4 MiB at most
+
+// shared memory segment, its pages are mapped by VMA_SHM of all users
+typedef struct shm {
+  char name[SHM_NAME + 1]; // empty if anonymous, only inherited by fork
+  uint32_t npage;
+  void **pages;            // frames of the segment, NULL until touched
+  int ref;                 // vmas using it
+  struct shm *next;        // in the list of named segments
+} shm_t;
+
+shm_t *shm_open(const char *name, uint32_t npage);
+shm_t *shm_dup(shm_t *shm);
+void shm_close(shm_t *shm);
+void *shm_page(shm_t *shm, uint32_t pgno);
+
+#endif
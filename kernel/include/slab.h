@@ -0,0 +1,23 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include "klib.h"
+
+struct slab;
+
+// cache of objects of one type, each slab is a page from kalloc
+typedef struct slab_cache {
+  const char *name;
+  size_t size;               // object size
+  void (*ctor)(void *obj);   // init an object at every alloc, may be NULL
+  struct slab *partial;      // slabs having free objects
+  struct slab *full;         // slabs without free objects
+  size_t nslab, inuse;       // slabs and objects in use, for statistics
+} slab_cache_t;
+
+#define SLAB_CACHE(name, type, ctor) {name, sizeof(type), ctor, NULL, NULL, 0, 0}
+
+void *slab_alloc(slab_cache_t *cache);
+void slab_free(slab_cache_t *cache, void *obj);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __SWAP_H__
+#define __SWAP_H__
+
+#include "klib.h"
+
+void init_swap(uint32_t sect, uint32_t npage);
+int swap_reclaim(int npage);
+int swap_in(PTE *pte);
+void swap_dup(PTE pte);
+void swap_drop(PTE pte);
+void swap_info(uint32_t *total, uint32_t *used);
+
+#endif
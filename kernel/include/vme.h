@@ -3,12 +3,40 @@
 
 #include "klib.h"
 
+#define MAX_ORDER   10 // largest block of buddy allocator is 4 MiB
+#define MAX_VMA     16
+#define STACK_LIMIT (8 * 1024 * 1024) // user stack grows down to USR_MEM - STACK_LIMIT
+#define MMAP_LIMIT  (1024 * 1024 * 1024) // mmap area is right below the stack
+#define MMAP_BASE   (USR_MEM - STACK_LIMIT - MMAP_LIMIT) // heap grows up to it
+
+// a range of user memory whose pages are mapped at the first touch
+typedef struct vma {
+  size_t start, end; // [start, end), page aligned
+  int prot;          // prot of PTEs mapped in it
+  enum {VMA_NONE, VMA_ANON, VMA_HEAP, VMA_STACK, VMA_FILE, VMA_SHARED, VMA_SHM} type;
+  struct inode *inode; // VMA_FILE/VMA_SHARED: pages come from its page cache
+  struct shm *shm;     // VMA_SHM: pages come from the segment
+  uint32_t off;        // file or segment offset of start, page aligned
+} vma_t;
+
+// VMA_FILE is a private mapping, writes go to copies of the cached pages;
+// VMA_SHARED maps the cached pages themselves, written back by vma_sync;
+// pages of VMA_SHARED and VMA_SHM are PTE_SHARED, fork keeps sharing them
+
 void init_gdt();
 void set_tss(uint32_t ss0, uint32_t esp0);
 
 void init_page();
 void *kalloc();
+void *kalloc_pages(int order);
 void kfree(void *ptr);
+void *kdup(void *ptr);
+int kref(void *ptr);
+uint32_t *ksum(void *ptr);
+size_t kavail(int order);
+void *kalloc_zeroed();
+int kzero_refill();
+void kmeminfo(struct meminfo *mi);
 
 PD *vm_alloc();
 void vm_teardown(PD *pgdir);
@@ -16,8 +44,20 @@ PD *vm_curr();
 PTE *vm_walkpte(PD *pgdir, size_t va, int prot);
 void *vm_walk(PD *pgdir, size_t va, int prot);
 void vm_map(PD *pgdir, size_t va, size_t len, int prot);
-void vm_unmap(PD *pgdir, size_t va, size_t len);
-void vm_copycurr(PD *pgdir);
-void vm_pgfault(size_t va, int errcode) __attribute__((noreturn));
+int vm_unmap(PD *pgdir, size_t va, size_t len);
+int vm_copycurr(PD *pgdir);
+int vm_copy(PD *pgdir, PD *src);
+size_t vm_resident(PD *pgdir);
+void vm_msync(PD *pgdir, vma_t *vma, size_t start, size_t end);
+void vm_pgfault(size_t va, int errcode);
+
+vma_t *vma_add(vma_t *vmas, size_t start, size_t end, int prot, int type);
+vma_t *vma_find(vma_t *vmas, size_t va);
+vma_t *vma_type(vma_t *vmas, int type);
+void vma_dup(vma_t *dst, vma_t *src);
+void vma_clear(vma_t *vmas);
+void vma_sync(PD *pgdir, vma_t *vmas);
+size_t vma_gap(vma_t *vmas, size_t len);
+int vma_cut(vma_t *vmas, vma_t *vma, size_t start, size_t end);
 
 #endif
@@ -73,6 +73,20 @@ static inline void set_cr0(uintptr_t cr0) {
   asm volatile ("mov %0, %%cr0" : : "r"(cr0));
 }
 
+static inline uintptr_t get_cr4(void) {
+  volatile uintptr_t val;
+  asm volatile ("mov %%cr4, %0" : "=r"(val));
+  return val;
+}
+
+static inline void set_cr4(uintptr_t cr4) {
+  asm volatile ("mov %0, %%cr4" : : "r"(cr4));
+}
+
+static inline void cpuid(uint32_t op, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+  asm volatile ("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(op));
+}
+
 static inline void set_idt(void *idt, int size) {
   static volatile struct {
     int16_t size;
@@ -117,6 +131,10 @@ static inline void flush_tlb() {
   set_cr3((void*)get_cr3());
 }
 
+static inline void invlpg(void *va) {
+  asm volatile ("invlpg (%0)" : : "r"(va) : "memory");
+}
+
 static inline int xchg(int *addr, int newval) {
   int result;
   asm volatile ("lock xchg %0, %1":
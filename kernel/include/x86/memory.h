@@ -17,12 +17,31 @@
 
 // Control Register flags
 #define CR0_PE         0x00000001  // Protection Enable
+#define CR0_WP         0x00010000  // Write Protect, ring 0 honors read-only pages
 #define CR0_PG         0x80000000  // Paging
+#define CR4_PSE        0x00000010  // Page Size Extensions, 4 MiB pages
+#define CR4_PGE        0x00000080  // Page Global Enable, global TLB entries survive CR3 load
+
+// CPUID.1:EDX feature flags
+#define CPUID_PSE      0x00000008  // Page Size Extensions
+#define CPUID_PGE      0x00002000  // Page Global Enable
 
 // Page table/directory entry flags
 #define PTE_P          0x001   // Present
 #define PTE_W          0x002   // Writeable
 #define PTE_U          0x004   // User
+#define PTE_A          0x020   // Accessed
+#define PTE_D          0x040   // Dirty
+#define PTE_PS         0x080   // Page Size, PDE maps a 4 MiB page
+#define PTE_G          0x100   // Global, kept in TLB when CR3 changes
+#define PTE_COW        0x200   // Copy on write (available for software)
+#define PTE_SWAP       0x400   // Swapped out when not present, frame is the slot (software)
+#define PTE_SHARED     0x800   // Shared writable page, fork keeps sharing it (software)
+
+// Page fault error code
+#define PF_P           0x1     // Fault on a present page (protection violation)
+#define PF_W           0x2     // Caused by a write
+#define PF_U           0x4     // Caused in user mode
 
 // GDT selectors
 #define KSEL(seg)      (((seg) << 3) | DPL_KERN)
@@ -76,9 +95,13 @@ typedef struct {
 
 
 #define KER_MEM   0x00200000  // the max static memory of kernel
-#define PHY_MEM   0x08000000  // QEMU has 128MB physical memory
+#define PHY_MEM   0x40000000  // top of kernel identity map, RAM above is unused
 #define USR_MEM   0xc0000000  // the memory top of user proc
 
+#define E820_MAP  0x00001000  // where bootloader saves the BIOS memory map
+#define E820_MAX  32          // max entries of the memory map
+#define E820_RAM  1           // type of usable memory
+
 #define PGSIZE    4096                           // page size in x86
 #define PGMASK    (PGSIZE - 1)                   // page mask in x86
 #define PGBITS    12                             // page bits in x86
@@ -142,6 +165,19 @@ typedef struct PageTable {
   PTE pte[NR_PTE] PG_ALIGN;
 } PT;
 
+/* memory map entry from BIOS int 0x15, eax = 0xe820 */
+typedef struct {
+  uint64_t base;
+  uint64_t len;
+  uint32_t type;
+} __attribute__((packed)) E820Entry;
+
+/* saved at E820_MAP by bootloader */
+typedef struct {
+  uint32_t num;
+  E820Entry entry[E820_MAX];
+} E820Map;
+
 #define MAKE_PDE(addr, prot) (PAGE_DOWN(addr) | (prot) | (PTE_P))
 #define MAKE_PTE(addr, prot) (PAGE_DOWN(addr) | (prot) | (PTE_P))
 
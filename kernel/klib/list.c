@@ -1,10 +1,7 @@
 #include "klib.h"
+#include "slab.h"
 
-#define LIST_NUM 256
-
-static list_t list_buf[LIST_NUM];
-static list_t free_list;
-static int inited = 0;
+static slab_cache_t list_cache = SLAB_CACHE("list", list_t, NULL);
 
 static void list_add_next(list_t *list, list_t *ptr) {
   ptr->prev = list;
@@ -21,18 +18,7 @@ static list_t *list_remove_prev(list_t *list) {
   return ptr;
 }
 
-static void init_list() {
-  list_init(&free_list);
-  for (int i = 0; i < LIST_NUM; ++i) {
-    list_add_next(&free_list, &list_buf[i]);
-  }
-}
-
 void list_init(list_t *list) {
-  if (!inited) {
-    inited = 1;
-    init_list();
-  }
   list->prev = list->next = list;
 }
 
@@ -41,7 +27,8 @@ int list_empty(list_t *list) {
 }
 
 list_t *list_enqueue(list_t *list, void *ptr) {
-  list_t *l = list_remove_prev(&free_list);
+  list_t *l = slab_alloc(&list_cache);
+  assert(l);
   l->ptr = ptr;
   list_add_next(list, l);
   return l;
@@ -53,12 +40,12 @@ void *list_dequeue(list_t *list) {
   }
   list_t *l = list_remove_prev(list);
   void *ptr = l->ptr;
-  list_add_next(&free_list, l);
+  slab_free(&list_cache, l);
   return ptr;
 }
 
 void list_remove(list_t *list, list_t *entry) {
   entry->next->prev = entry->prev;
   entry->prev->next = entry->next;
-  list_add_next(&free_list, entry);
+  slab_free(&list_cache, entry);
 }
@@ -83,6 +83,26 @@ void bwrite(const void *src, uint32_t size, uint32_t no, uint32_t off) {
   copy_to_disk(bc->buf, BLK_SIZE, no * BLK_SIZE);
 }
 
+void bread_direct(void *dst, uint32_t no) {
+  // read whole blk no to dst without polluting the cache
+  // bwrite writes through, so disk is as new as the cached copy
+  bcache_t *bc = &blk_cache[no % BCACHE_NUM];
+  if (bc->valid && bc->no == no) {
+    memcpy(dst, bc->buf, BLK_SIZE);
+  } else {
+    copy_from_disk(dst, BLK_SIZE, no * BLK_SIZE);
+  }
+}
+
+void bwrite_direct(const void *src, uint32_t no) {
+  // write whole blk no from src, keep the cached copy coherent
+  bcache_t *bc = &blk_cache[no % BCACHE_NUM];
+  if (bc->valid && bc->no == no) {
+    memcpy(bc->buf, src, BLK_SIZE);
+  }
+  copy_to_disk(src, BLK_SIZE, no * BLK_SIZE);
+}
+
 void bzero(uint32_t no) {
   bcache_t *bc = bgetcache(no);
   memset(bc->buf, 0, BLK_SIZE);
@@ -1,21 +1,20 @@
 #include "klib.h"
 #include "file.h"
+#include "vme.h"
+#include "slab.h"
 
-#define TOTAL_FILE 128
-
-file_t files[TOTAL_FILE];
+static slab_cache_t file_cache = SLAB_CACHE("file", file_t, NULL);
 
 static file_t *falloc() {
-  // Lab3-1: find a file whose ref==0, init it, inc ref and return it, return NULL if none
+  // Lab3-1: alloc a file from file_cache, init it, inc ref and return it, return NULL if no memory
   // TODO();
-  for (int i = 0; i < TOTAL_FILE; i++) {
-    if (files[i].ref == 0) {
-      files[i].type = TYPE_NONE;
-      files[i].ref++;
-      return &files[i];
-    }
+  file_t *file = slab_alloc(&file_cache);
+  if (file == NULL) {
+    return NULL;
   }
-  return NULL;
+  file->type = TYPE_NONE;
+  file->ref++;
+  return file;
 }
 
 file_t *fopen(const char *path, int mode) {
@@ -41,6 +40,7 @@ file_t *fopen(const char *path, int mode) {
     fp->type = TYPE_FILE; // file_t don't and needn't distingush between file and dir
     fp->inode = ip;
     fp->offset = 0;
+    fp->direct = (mode & O_DIRECT) != 0;
   } else if (type == TYPE_DEV) {
     fp->type = TYPE_DEV;
     fp->dev_op = dev_get(idevid(ip));
@@ -62,7 +62,9 @@ int fread(file_t *file, void *buf, uint32_t size) {
   if (!file->readable) return -1;
   // TODO();
   if (file->type == TYPE_FILE) {
-    int nums = iread(file->inode, file->offset, buf, size);
+    // O_DIRECT only works for aligned transfer, otherwise go through cache
+    int nums = file->direct ? iread_direct(file->inode, file->offset, buf, size) : -1;
+    if (nums == -1) nums = iread(file->inode, file->offset, buf, size);
     if (nums != -1) {
       file->offset += nums;
     }
@@ -80,7 +82,8 @@ int fwrite(file_t *file, const void *buf, uint32_t size) {
   if (!file->writable) return -1;
   // TODO();
   if (file->type == TYPE_FILE) {
-    int nums = iwrite(file->inode, file->offset, buf, size);
+    int nums = file->direct ? iwrite_direct(file->inode, file->offset, buf, size) : -1;
+    if (nums == -1) nums = iwrite(file->inode, file->offset, buf, size);
     if (nums != -1) {
       file->offset += nums;
     }
@@ -92,6 +95,57 @@ int fwrite(file_t *file, const void *buf, uint32_t size) {
   return -1;
 }
 
+int fsendfile(file_t *out, file_t *in, uint32_t size) {
+  // copy at most size bytes from in to out inside kernel, without user buffer
+  // stop at a short read, just like a read-write loop would see it
+  if (!in->readable || !out->writable) return -1;
+  char *buf = kalloc();
+  if (buf == NULL) return -1;
+  int total = 0;
+  while (total < size) {
+    uint32_t chunk = MIN(size - total, PGSIZE);
+    int nr = fread(in, buf, chunk);
+    if (nr <= 0) {
+      if (total == 0) total = nr;
+      break;
+    }
+    // for dev file, fwrite goes to dev_op->write directly
+    int nw = fwrite(out, buf, nr);
+    if (nw < 0) {
+      if (total == 0) total = nw;
+      break;
+    }
+    total += nw;
+    if (nw < nr || nr < chunk) break;
+  }
+  kfree(buf);
+  return total;
+}
+
+int freadv(file_t *file, const struct iovec *iov, int iovcnt) {
+  // fill iov one by one, stop at a short read
+  int total = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    int n = fread(file, iov[i].iov_base, iov[i].iov_len);
+    if (n < 0) return total == 0 ? n : total;
+    total += n;
+    if (n < iov[i].iov_len) break;
+  }
+  return total;
+}
+
+int fwritev(file_t *file, const struct iovec *iov, int iovcnt) {
+  // write iov one by one, stop at a short write
+  int total = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    int n = fwrite(file, iov[i].iov_base, iov[i].iov_len);
+    if (n < 0) return total == 0 ? n : total;
+    total += n;
+    if (n < iov[i].iov_len) break;
+  }
+  return total;
+}
+
 uint32_t fseek(file_t *file, uint32_t off, int whence) {
   // Lab3-1, change file's offset, do not let it cross file's size
   if (file->type == TYPE_FILE) {
@@ -123,4 +177,7 @@ void fclose(file_t *file) {
   if(file->ref == 0 && file->type == TYPE_FILE) {
     iclose(file->inode);
   }
+  if(file->ref == 0) {
+    slab_free(&file_cache, file);
+  }
 }
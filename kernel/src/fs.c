@@ -2,12 +2,33 @@
 #include "fs.h"
 #include "disk.h"
 #include "proc.h"
+#include "pcache.h"
+#include "swap.h"
 
 #ifdef EASY_FS
 
-#define MAX_FILE  (SECTSIZE / sizeof(dinode_t))
-#define MAX_DEV   16
-#define MAX_INODE (MAX_FILE + MAX_DEV)
+// Disk layout of user.img (sector numbers relative to the disk):
+//   [ header | dinode table | name hash | file data | swap ]
+//   256        257            +DIR_SECT   +HASH_SECT            swap_start
+#define EASY_MAGIC 0x59534145 // "EASY"
+#define MAX_FILE   512
+#define MAX_DEV    16
+#define MAX_INODE  (MAX_FILE + MAX_DEV)
+#define ROOT_INO   MAX_INODE // the only dir, holds all files
+#define HASH_SIZE  1024 // power of 2, slot holds ino+1, 0 marks empty
+#define HEAD_SECT  256
+#define DIR_SECT   (MAX_FILE * sizeof(dinode_t) / SECTSIZE)
+#define HASH_SECT  (HASH_SIZE * sizeof(uint16_t) / SECTSIZE)
+#define DPERSECT   (SECTSIZE / sizeof(dinode_t)) // dinode num per sector
+
+// On disk header
+typedef struct {
+  uint32_t magic;
+  uint32_t nfile;     // valid dinodes in the dinode table
+  uint32_t hash_size; // must be HASH_SIZE
+  uint32_t swap_start; // first sector of swap area
+  uint32_t swap_pages; // pages of swap area
+} easy_sb_t;
 
 // On disk inode
 typedef struct dinode {
@@ -21,26 +42,59 @@ struct inode {
   int valid;
   int type;
   int dev; // dev_id if type==TYPE_DEV
+  uint32_t version; // changes at every write
   dinode_t dinode;
 };
 
-static inode_t inodes[MAX_INODE];
+static inode_t inodes[MAX_INODE + 1];
+static uint32_t version_clock;
+static uint16_t name_hash[HASH_SIZE];
+
+// FNV-1a, must match utils/genuser.c
+static uint32_t name_hashfn(const char *name) {
+  uint32_t h = 2166136261u;
+  for (; *name; ++name) {
+    h = (h ^ (uint8_t)*name) * 16777619u;
+  }
+  return h;
+}
 
 void init_fs() {
-  dinode_t buf[MAX_FILE];
-  read_disk(buf, 256);
-  for (int i = 0; i < MAX_FILE; ++i) {
+  dinode_t buf[DPERSECT];
+  read_disk(buf, HEAD_SECT);
+  easy_sb_t sb = *(easy_sb_t*)buf;
+  assert(sb.magic == EASY_MAGIC);
+  assert(sb.hash_size == HASH_SIZE);
+  assert(sb.nfile <= MAX_FILE);
+  init_swap(sb.swap_start, sb.swap_pages);
+  // only read the sectors of dinode table which are in use
+  for (int i = 0; i < sb.nfile; ++i) {
+    if (i % DPERSECT == 0) {
+      read_disk(buf, HEAD_SECT + 1 + i / DPERSECT);
+    }
     inodes[i].valid = 1;
     inodes[i].type = TYPE_FILE;
-    inodes[i].dinode = buf[i];
+    inodes[i].dinode = buf[i % DPERSECT];
+  }
+  for (int i = 0; i < HASH_SECT; ++i) {
+    read_disk((uint8_t*)name_hash + i * SECTSIZE, HEAD_SECT + 1 + DIR_SECT + i);
   }
+  inodes[ROOT_INO].valid = 1;
+  inodes[ROOT_INO].type = TYPE_DIR;
+  strcpy(inodes[ROOT_INO].dinode.name, "/");
 }
 
 inode_t *iopen(const char *path, int type) {
-  for (int i = 0; i < MAX_INODE; ++i) {
-    if (!inodes[i].valid) continue;
-    if (strcmp(path, inodes[i].dinode.name) == 0) {
-      return &inodes[i];
+  if (strcmp(path, "/") == 0 || strcmp(path, ".") == 0) {
+    return &inodes[ROOT_INO];
+  }
+  uint32_t h = name_hashfn(path);
+  for (int i = 0; i < HASH_SIZE; ++i) {
+    uint16_t slot = name_hash[(h + i) & (HASH_SIZE - 1)];
+    if (slot == 0) break; // reach an empty slot, no such file
+    inode_t *inode = &inodes[slot - 1];
+    if (inode->valid && strcmp(path, inode->dinode.name) == 0) {
+      return inode;
     }
   }
   return NULL;
@@ -48,20 +102,25 @@ inode_t *iopen(const char *path, int type) {
 
 int iread(inode_t *inode, uint32_t off, void *buf, uint32_t len) {
   assert(inode);
-  char *cbuf = buf;
-  char dbuf[SECTSIZE];
-  uint32_t curr = -1;
+  return pcache_read(inode, off, buf, len);
+}
+
+int iread_direct(inode_t *inode, uint32_t off, void *buf, uint32_t len) {
+  // read whole sectors from disk to buf directly, return -1 if not aligned
+  // the padding of last sector is read too, it is still inside buf
+  assert(inode);
+  if (off % SECTSIZE != 0 || len % SECTSIZE != 0) return -1;
   uint32_t total_len = inode->dinode.length;
-  uint32_t st_sect = inode->dinode.start_sect;
-  int i;
-  for (i = 0; i < len && off < total_len; ++i, ++off) {
-    if (curr != off / SECTSIZE) {
-      read_disk(dbuf, st_sect + off / SECTSIZE);
-      curr = off / SECTSIZE;
-    }
-    *cbuf++ = dbuf[off % SECTSIZE];
+  if (off >= total_len) return 0;
+  len = MIN(len, total_len - off);
+  for (uint32_t i = 0; i < len; i += SECTSIZE) {
+    read_disk((char*)buf + i, inode->dinode.start_sect + (off + i) / SECTSIZE);
   }
-  return i;
+  return len;
+}
+
+int iwrite_direct(inode_t *inode, uint32_t off, const void *buf, uint32_t len) {
+  return -1; // write doesn't support, let caller fall back
 }
 
 void iadddev(const char *name, int id) {
@@ -71,6 +130,16 @@ void iadddev(const char *name, int id) {
   inode->type = TYPE_DEV;
   inode->dev = id;
   strcpy(inode->dinode.name, name);
+  // add it to name hash, so iopen can find it as a normal file
+  uint32_t h = name_hashfn(name);
+  for (int i = 0; i < HASH_SIZE; ++i) {
+    uint16_t *slot = &name_hash[(h + i) & (HASH_SIZE - 1)];
+    if (*slot == 0) {
+      *slot = MAX_FILE + id + 1;
+      return;
+    }
+  }
+  panic("name hash full");
 }
 
 uint32_t isize(inode_t *inode) {
@@ -85,12 +154,34 @@ uint32_t ino(inode_t *inode) {
   return inode - inodes;
 }
 
+uint32_t iversion(inode_t *inode) {
+  return inode->version;
+}
+
 int idevid(inode_t *inode) {
   return inode->type == TYPE_DEV ? inode->dev : -1;
 }
 
 int iwrite(inode_t *inode, uint32_t off, const void *buf, uint32_t len) {
-  panic("write doesn't support");
+  // a file is contiguous sectors, so it can be written inside but not grow
+  assert(inode);
+  uint32_t total_len = inode->dinode.length;
+  if (off > total_len) return -1;
+  len = MIN(len, total_len - off);
+  pcache_write(inode, off, buf, len);
+  char dbuf[SECTSIZE];
+  for (uint32_t i = 0; i < len; ) {
+    uint32_t sect = inode->dinode.start_sect + (off + i) / SECTSIZE;
+    uint32_t soff = (off + i) % SECTSIZE, n = MIN(len - i, SECTSIZE - soff);
+    if (n < SECTSIZE) {
+      read_disk(dbuf, sect); // keep the rest of sector
+    }
+    memcpy(dbuf + soff, (const char*)buf + i, n);
+    write_disk(dbuf, sect);
+    i += n;
+  }
+  inode->version = ++version_clock;
+  return len;
 }
 
 void itrunc(inode_t *inode) {
@@ -107,6 +198,25 @@ int iremove(const char *path) {
   panic("remove doesn't support");
 }
 
+int igetdents(inode_t *dir, uint32_t *off, struct dirent_stat *de, int count, int flags) {
+  // the root dir is flat, its entries are just all valid inodes
+  static_assert(sizeof(de->name) > MAX_NAME, "name of dirent_stat too short");
+  if (dir->type != TYPE_DIR) return -1;
+  int n = 0;
+  for (; *off < MAX_INODE && n < count; ++*off) {
+    inode_t *inode = &inodes[*off];
+    if (!inode->valid) continue;
+    strcpy(de[n].name, inode->dinode.name);
+    if (flags & GD_STAT) {
+      de[n].st.type = inode->type;
+      de[n].st.size = inode->dinode.length;
+      de[n].st.node = *off;
+    }
+    ++n;
+  }
+  return n;
+}
+
 #else
 
 #define DISK_SIZE (128 * 1024 * 1024)
@@ -123,6 +233,8 @@ typedef struct super_block {
   uint32_t istart; // start block no of inode blocks
   uint32_t inum;   // total inode num
   uint32_t root;   // inode no of root dir
+  uint32_t swap_start; // start block no of swap area
+  uint32_t swap_num;   // blocks of swap area, one page each
 } sb_t;
 
 // On disk inode
@@ -137,14 +249,19 @@ struct inode {
   int no;
   int ref;
   int del;
+  uint32_t version; // changes whenever the content changes
   dinode_t dinode;
 };
 
+static uint32_t version_clock;
+
 #define SUPER_BLOCK 32
 static sb_t sb;
 
 void init_fs() {
   bread(&sb, sizeof(sb), SUPER_BLOCK, 0);
+  static_assert(BLK_SIZE == PGSIZE, "a swap block holds a page");
+  init_swap(sb.swap_start * (BLK_SIZE / SECTSIZE), sb.swap_num);
 }
 
 #define I2BLKNO(no)  (sb.istart + no / IPERBLK)
@@ -205,9 +322,15 @@ static inode_t *iget(uint32_t no) {
   // if there exist one inode whose no is just no, inc its ref and return it
   // otherwise, find a empty inode slot, init it and return it
   // if no empty inode slot, just abort
+  // a new inode gets a fresh version: inode->version = ++version_clock
   TODO();
 }
 
+static void imodify(inode_t *inode) {
+  // content of inode is changing, what is made from it is stale
+  inode->version = ++version_clock;
+}
+
 static void iupdate(inode_t *inode) {
   // Lab3-2: sync the inode->dinode to disk
   // call me EVERYTIME after you edit inode->dinode
@@ -355,8 +478,8 @@ static uint32_t iwalk(inode_t *inode, uint32_t no) {
 
 int iread(inode_t *inode, uint32_t off, void *buf, uint32_t len) {
   // Lab3-2: read the inode's data [off, MIN(off+len, size)) to buf
-  // use iwalk to get the blkno and read blk by blk
-  TODO();
+  // pages are filled by iread_direct, which uses iwalk to read blk by blk
+  return pcache_read(inode, off, buf, len);
 }
 
 int iwrite(inode_t *inode, uint32_t off, const void *buf, uint32_t len) {
@@ -364,12 +487,46 @@ int iwrite(inode_t *inode, uint32_t off, const void *buf, uint32_t len) {
   // if off>size, return -1 (can not cross size before write)
   // if off+len>size, update it as new size (but can cross size after write)
   // use iwalk to get the blkno and read blk by blk
+  // cached pages of [off, off+len) must be updated by pcache_write too
+  if (off > inode->dinode.size) return -1;
+  imodify(inode);
+  pcache_write(inode, off, buf, len);
   TODO();
 }
 
+int iread_direct(inode_t *inode, uint32_t off, void *buf, uint32_t len) {
+  // read whole blocks to buf without the block cache, return -1 if not aligned
+  if (off % BLK_SIZE != 0 || len % BLK_SIZE != 0) return -1;
+  uint32_t size = inode->dinode.size;
+  if (off >= size) return 0;
+  len = MIN(len, size - off);
+  for (uint32_t i = 0; i < len; i += BLK_SIZE) {
+    bread_direct((char*)buf + i, iwalk(inode, (off + i) / BLK_SIZE));
+  }
+  return len;
+}
+
+int iwrite_direct(inode_t *inode, uint32_t off, const void *buf, uint32_t len) {
+  // write whole blocks from buf without the block cache, return -1 if not aligned
+  if (off % BLK_SIZE != 0 || len % BLK_SIZE != 0) return -1;
+  if (off > inode->dinode.size) return -1;
+  imodify(inode);
+  pcache_write(inode, off, buf, len);
+  for (uint32_t i = 0; i < len; i += BLK_SIZE) {
+    bwrite_direct((const char*)buf + i, iwalk(inode, (off + i) / BLK_SIZE));
+  }
+  if (off + len > inode->dinode.size) {
+    inode->dinode.size = off + len;
+    iupdate(inode);
+  }
+  return len;
+}
+
 void itrunc(inode_t *inode) {
   // Lab3-2: free all data block used by inode (direct and indirect)
   // mark all address of inode 0 and mark its size 0
+  pcache_drop(inode);
+  imodify(inode);
   TODO();
 }
 
@@ -400,6 +557,10 @@ uint32_t ino(inode_t *inode) {
   return inode->no;
 }
 
+uint32_t iversion(inode_t *inode) {
+  return inode->version;
+}
+
 int idevid(inode_t *inode) {
   return itype(inode) == TYPE_DEV ? inode->dinode.device : -1;
 }
@@ -431,4 +592,27 @@ int iremove(const char *path) {
   TODO();
 }
 
+int igetdents(inode_t *dir, uint32_t *off, struct dirent_stat *de, int count, int flags) {
+  // walk the dir from off once, stat of entry is read from its dinode directly
+  // (iupdate writes every change through, so no need to iget it)
+  static_assert(sizeof(de->name) > MAX_NAME, "name of dirent_stat too short");
+  if (dir->dinode.type != TYPE_DIR) return -1;
+  dirent_t dirent;
+  dinode_t dinode;
+  int n = 0;
+  for (; *off + sizeof dirent <= dir->dinode.size && n < count; *off += sizeof dirent) {
+    iread(dir, *off, &dirent, sizeof dirent);
+    if (dirent.inode == 0) continue;
+    strcpy(de[n].name, dirent.name);
+    if (flags & GD_STAT) {
+      diread(&dinode, dirent.inode);
+      de[n].st.type = dinode.type;
+      de[n].st.size = dinode.size;
+      de[n].st.node = dirent.inode;
+    }
+    ++n;
+  }
+  return n;
+}
+
 #endif
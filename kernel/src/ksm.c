@@ -0,0 +1,142 @@
+#include "klib.h"
+#include "vme.h"
+#include "proc.h"
+#include "ksm.h"
+
+// Same page merging: scan anonymous pages of procs in the background, and
+// merge pages with same content into one read-only copy-on-write frame.
+// A page is a candidate only if its checksum doesn't change between two
+// scans. Then it is merged into a stable page of same content, or becomes
+// a stable page itself. The stable table holds a reference of each stable
+// page, a stable page only the table uses is dropped when its slot is needed.
+
+#define STABLE_NUM  512 // power of 2
+#define STABLE_PROB 8   // probe length in the stable table
+
+typedef struct {
+  uint32_t sum;
+  void *page; // NULL if empty
+} stable_t;
+
+static stable_t stable[STABLE_NUM];
+
+// scan hand, proc and va to scan next
+static int hand_pid;
+static size_t hand_va = PHY_MEM;
+
+static uint32_t page_sum(const void *page) {
+  // FNV-1a over words
+  const uint32_t *p = page;
+  uint32_t h = 2166136261u;
+  for (int i = 0; i < PGSIZE / sizeof(uint32_t); i++) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+static void *stable_merge(void *page, uint32_t sum) {
+  // return a stable page same as page, or make page a stable one and return it,
+  // NULL if neither can be done
+  stable_t *victim = NULL;
+  for (int i = 0; i < STABLE_PROB; i++) {
+    stable_t *st = &stable[(sum + i) & (STABLE_NUM - 1)];
+    if (st->page != NULL && st->sum == sum && st->page != page &&
+        memcmp(st->page, page, PGSIZE) == 0) {
+      return st->page;
+    }
+    if (victim == NULL && (st->page == NULL || kref(st->page) == 1)) {
+      victim = st;
+    }
+  }
+  if (victim != NULL) {
+    kfree(victim->page);
+    victim->sum = sum;
+    victim->page = kdup(page);
+    return page;
+  }
+  return NULL;
+}
+
+static int ksm_scanproc(proc_t *proc, int npage) {
+  // scan proc from hand_va, return number of pages scanned
+  PD *pgdir = proc->pgdir;
+  int scanned = 0, flush = 0;
+  for (; hand_va < USR_MEM && scanned < npage; hand_va += PGSIZE) {
+    PDE *pde = &pgdir->pde[ADDR2DIR(hand_va)];
+    if (!pde->present || (pde->val & PTE_PS)) {
+      // skip the whole empty page table, or huge page which stays in memory
+      hand_va = PAGE_DOWN(hand_va | (PT_SIZE - 1));
+      continue;
+    }
+    PTE *pte = &PDE2PT(*pde)->pte[ADDR2TBL(hand_va)];
+    if (!pte->present || kref(PTE2PG(*pte)) > 1) {
+      continue;
+    }
+    vma_t *vma = vma_find(proc->vmas, hand_va);
+    if (vma == NULL || vma->inode != NULL) {
+      continue;
+    }
+    scanned++;
+    void *page = PTE2PG(*pte);
+    uint32_t *sum = ksum(page);
+    uint32_t now = page_sum(page);
+    if (now != *sum) {
+      // still changing, check it next time
+      *sum = now;
+      continue;
+    }
+    void *same = stable_merge(page, now);
+    if (same == NULL) {
+      continue;
+    }
+    // it is shared now, so read only
+    int prot = (pte->val & PTE_U) | ((pte->val & (PTE_W | PTE_COW)) ? PTE_COW : 0);
+    if (same != page) {
+      pte->val = MAKE_PTE(kdup(same), prot);
+      kfree(page);
+    } else {
+      pte->val = MAKE_PTE(page, prot);
+    }
+    flush = 1;
+  }
+  if (flush && pgdir == vm_curr()) {
+    flush_tlb();
+  }
+  return scanned;
+}
+
+void ksm_scan(int npage) {
+  // scan at most npage anonymous pages round all procs, called by idle loop
+  int scanned = 0;
+  proc_t *proc = proc_find(hand_pid);
+  if (proc == NULL) {
+    proc = proc_next(NULL);
+    hand_va = PHY_MEM;
+  }
+  for (proc_t *start = proc; proc != NULL; ) {
+    scanned += ksm_scanproc(proc, npage - scanned);
+    if (scanned >= npage) {
+      break;
+    }
+    proc = proc_next(proc);
+    if (proc == NULL) {
+      proc = proc_next(NULL); // wrap around
+    }
+    hand_va = PHY_MEM;
+    if (proc == start) {
+      break;
+    }
+  }
+  hand_pid = proc ? proc->pid : 0;
+}
+
+uint32_t ksm_saved() {
+  // pages saved by merging, users of a stable page but one share it
+  uint32_t saved = 0;
+  for (int i = 0; i < STABLE_NUM; i++) {
+    if (stable[i].page != NULL && kref(stable[i].page) > 2) {
+      saved += kref(stable[i].page) - 2;
+    }
+  }
+  return saved;
+}
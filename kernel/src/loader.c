@@ -6,54 +6,146 @@
 #include "fs.h"
 #include <elf.h>
 
-uint32_t load_elf(PD *pgdir, const char *name)
+static uint32_t load_inode(PD *pgdir, vma_t *vmas, inode_t *inode)
 {
   Elf32_Ehdr elf;
   Elf32_Phdr ph;
 
-  // PD *current_pgdir = vm_curr();
-  // set_cr3(pgdir);
-
-  inode_t *inode = iopen(name, TYPE_NONE);
-  if (!inode) {
-    // set_cr3(current_pgdir);
-    return -1;
-  }
-    
   iread(inode, 0, &elf, sizeof(elf));
   if (*(uint32_t *)(&elf) != 0x464c457f) { 
-
-    iclose(inode);
     return -1;
   }
+  memset(vmas, 0, MAX_VMA * sizeof(vma_t));
   for (int i = 0; i < elf.e_phnum; ++i) {
     iread(inode, elf.e_phoff + i * sizeof(ph), &ph, sizeof(ph));
     if (ph.p_type == PT_LOAD) {
       // Lab1-2: Load segment to physical memory
       // Lab1-4: Load segment to virtual memory
       // TODO();
-      PD *current_pgdir = vm_curr();
-      set_cr3(pgdir);
-      vm_map(pgdir, ph.p_vaddr, ph.p_memsz, (ph.p_flags & PF_W) ? 7 : 5);
-
-      void *pa = vm_walk(pgdir, ph.p_vaddr, 7);
-      memset((void *)pa, 0, ph.p_memsz);
-      iread(inode, ph.p_offset, (void *)pa, ph.p_filesz);
-      set_cr3(current_pgdir);
-      // memcpy((void *)ph.p_vaddr, (void *)((uint32_t)inode + ph.p_offset), ph.p_filesz);
+      int prot = (ph.p_flags & PF_W) ? 7 : 5;
+      size_t file_end = ph.p_vaddr + ph.p_filesz;
+      size_t lazy_end = PAGE_DOWN(ph.p_vaddr);
+      if (ADDR2OFF(ph.p_vaddr) == ADDR2OFF(ph.p_offset)) {
+        // whole pages of file data are faulted in from the page cache and
+        // shared by all procs running it, except a last page having bss
+        lazy_end = ph.p_memsz > ph.p_filesz ? PAGE_DOWN(file_end) : PAGE_UP(file_end);
+        if (lazy_end > PAGE_DOWN(ph.p_vaddr)) {
+          vma_t *vma = vma_add(vmas, PAGE_DOWN(ph.p_vaddr), lazy_end, prot, VMA_FILE);
+          assert(vma);
+          vma->inode = idup(inode);
+          vma->off = PAGE_DOWN(ph.p_offset);
+        }
+      }
+      // other pages holding file data are loaded now, the rest (bss) on demand
+      if (PAGE_UP(ph.p_vaddr + ph.p_memsz) > lazy_end) {
+        assert(vma_add(vmas, lazy_end, PAGE_UP(ph.p_vaddr + ph.p_memsz), prot, VMA_ANON));
+      }
+      for (size_t va = lazy_end; va < file_end; va += PGSIZE) {
+        size_t from = MAX(va, ph.p_vaddr), to = MIN(va + PGSIZE, file_end);
+        // pages are not contiguous in physical memory, fill them one by one
+        vm_map(pgdir, va, PGSIZE, prot);
+        char *page = vm_walk(pgdir, va, prot);
+        iread(inode, ph.p_offset + (from - ph.p_vaddr), page + (from - va), to - from);
+      }
     }
   }
   // TODO: Lab1-4 alloc stack memory in pgdir
-  vm_map(pgdir, USR_MEM - PGSIZE, PGSIZE, 7);
-  iclose(inode);
+  // stack grows on demand, its top page is mapped by load_arg
+  assert(vma_add(vmas, USR_MEM - STACK_LIMIT, USR_MEM, 7, VMA_STACK));
   return elf.e_entry;
 }
 
+uint32_t load_elf(PD *pgdir, vma_t *vmas, const char *name)
+{
+  inode_t *inode = iopen(name, TYPE_NONE);
+  if (!inode) {
+    return -1;
+  }
+  uint32_t entry = load_inode(pgdir, vmas, inode);
+  iclose(inode);
+  return entry;
+}
+
+// Exec template cache: prepared images of recently loaded programs,
+// exec of a cached one just copies the template with copy-on-write.
+// The template never runs, so it stays as load_inode left it.
+
+#define TMPL_NUM 8
+
+typedef struct {
+  PD *pgdir; // NULL if the slot is empty
+  vma_t vmas[MAX_VMA];
+  uint32_t ino, version, entry;
+  uint32_t stamp; // last used time, the least recent one is replaced
+} tmpl_t;
+
+static tmpl_t tmpls[TMPL_NUM];
+static uint32_t tmpl_clock;
+
+static void tmpl_free(tmpl_t *t)
+{
+  vm_teardown(t->pgdir);
+  vma_clear(t->vmas);
+  t->pgdir = NULL;
+}
+
+static tmpl_t *tmpl_get(inode_t *inode)
+{
+  // return the template of inode, make one if not cached
+  tmpl_t *victim = &tmpls[0];
+  for (int i = 0; i < TMPL_NUM; i++) {
+    tmpl_t *t = &tmpls[i];
+    if (t->pgdir != NULL && t->ino == ino(inode) && t->version == iversion(inode)) {
+      t->stamp = ++tmpl_clock;
+      return t;
+    }
+    if (victim->pgdir != NULL && (t->pgdir == NULL || t->stamp < victim->stamp)) {
+      victim = t;
+    }
+  }
+  if (victim->pgdir != NULL) {
+    tmpl_free(victim);
+  }
+  PD *pgdir = vm_alloc();
+  if (pgdir == NULL) {
+    return NULL;
+  }
+  victim->entry = load_inode(pgdir, victim->vmas, inode);
+  victim->pgdir = pgdir;
+  if (victim->entry == -1) {
+    tmpl_free(victim);
+    return NULL;
+  }
+  victim->ino = ino(inode);
+  victim->version = iversion(inode);
+  victim->stamp = ++tmpl_clock;
+  return victim;
+}
+
+static uint32_t load_cached(PD *pgdir, vma_t *vmas, const char *name)
+{
+  inode_t *inode = iopen(name, TYPE_NONE);
+  if (!inode) {
+    return -1;
+  }
+  tmpl_t *t = itype(inode) == TYPE_FILE ? tmpl_get(inode) : NULL;
+  iclose(inode);
+  if (t == NULL) {
+    return -1;
+  }
+  if (vm_copy(pgdir, t->pgdir) != 0) {
+    return -1;
+  }
+  vma_dup(vmas, t->vmas);
+  return t->entry;
+}
+
 #define MAX_ARGS_NUM 31
 
 uint32_t load_arg(PD *pgdir, char *const argv[])
 {
   // Lab1-8: Load argv to user stack
+  vm_map(pgdir, USR_MEM - PGSIZE, PGSIZE, 7);
   char *stack_top = (char *)vm_walk(pgdir, USR_MEM - PGSIZE, 7) + PGSIZE;
   size_t argv_va[MAX_ARGS_NUM + 1];
   int argc;
@@ -86,9 +178,9 @@ uint32_t load_arg(PD *pgdir, char *const argv[])
   return USR_MEM - PGSIZE + ADDR2OFF(stack_top);
 }
 
-int load_user(PD *pgdir, Context *ctx, const char *name, char *const argv[])
+int load_user(PD *pgdir, vma_t *vmas, Context *ctx, const char *name, char *const argv[])
 {
-  size_t eip = load_elf(pgdir, name);
+  size_t eip = load_cached(pgdir, vmas, name);
   if (eip == -1)
     return -1;
   ctx->cs = USEL(SEG_UCODE);
@@ -7,6 +7,7 @@
 #include "proc.h"
 #include "timer.h"
 #include "dev.h"
+#include "ksm.h"
 
 void init_user_and_go();
 
@@ -38,11 +39,19 @@ void init_user_and_go()
   assert(proc);
   // char *argv[] = {"childtest", "1", "10", "1", NULL};
   char *argv[] = {"readtest", NULL};
-  assert(load_user(proc->pgdir, proc->ctx, "readtest", argv) == 0);
+  assert(load_user(proc->pgdir, proc->vmas, proc->ctx, "readtest", argv) == 0);
   proc_addready(proc);
 
   sti();
-  while (1);
+  // idle loop, prepare zeroed pages for others, then merge same pages
+  while (1) {
+    if (!kzero_refill()) {
+      cli();
+      ksm_scan(KSM_BATCH);
+      sti();
+      hlt(); // nothing more to do until next interrupt
+    }
+  }
 
 
 
@@ -0,0 +1,203 @@
+#include "klib.h"
+#include "vme.h"
+#include "fs.h"
+#include "slab.h"
+#include "pcache.h"
+
+// Page cache of file contents, one kalloc'd page per (inode, page number).
+// The cache holds a reference of each page, and users (e.g. PTEs of a
+// mapped text segment) hold theirs, so a page is only evicted when the
+// cache is the last one using it. read goes through it and write updates
+// it, so mapped pages and read/write always see the same content.
+// A shared mapping must get the cached page, so when all entries are in
+// use it gets an extra one from a slab, freed once no one else uses it.
+
+#define PCACHE_NUM  1024
+#define PCACHE_HASH 256 // power of 2
+
+typedef struct pcpage {
+  uint32_t ino, pgno;
+  void *page; // NULL if the entry is free
+  struct pcpage *next; // in the hash chain
+  struct pcpage *extra_next; // in the list of extra entries
+} pcpage_t;
+
+static pcpage_t pcpages[PCACHE_NUM];
+static pcpage_t *pchash[PCACHE_HASH];
+static int pchand; // clock hand to pick a victim when full
+static slab_cache_t pcextra_cache = SLAB_CACHE("pcextra", pcpage_t, NULL);
+static pcpage_t *pcextra; // extra entries beyond pcpages
+
+#define PCHASH(ino, pgno) (((ino) * 31 + (pgno)) & (PCACHE_HASH - 1))
+
+static void pcache_unlink(pcpage_t *pc) {
+  pcpage_t **pp = &pchash[PCHASH(pc->ino, pc->pgno)];
+  while (*pp != pc) {
+    pp = &(*pp)->next;
+  }
+  *pp = pc->next;
+  kfree(pc->page);
+  pc->page = NULL;
+}
+
+static void pcextra_free(pcpage_t **pp) {
+  // free the extra entry *pp and its page, *pp becomes the next one
+  pcpage_t *pc = *pp;
+  *pp = pc->extra_next;
+  pcache_unlink(pc);
+  slab_free(&pcextra_cache, pc);
+}
+
+static void pcache_trim() {
+  // free extra entries whose pages no one else uses any more
+  for (pcpage_t **pp = &pcextra; *pp != NULL; ) {
+    if (kref((*pp)->page) == 1) {
+      pcextra_free(pp);
+    } else {
+      pp = &(*pp)->extra_next;
+    }
+  }
+}
+
+static pcpage_t *pcache_alloc(int extra) {
+  // find a free entry, or evict a page no one else uses, and if all pages
+  // are in use, return an extra entry if extra, NULL if not
+  pcache_trim();
+  for (int i = 0; i < 2 * PCACHE_NUM; i++) {
+    pcpage_t *pc = &pcpages[pchand];
+    pchand = (pchand + 1) % PCACHE_NUM;
+    if (pc->page == NULL) {
+      return pc;
+    }
+    if (i >= PCACHE_NUM && kref(pc->page) == 1) {
+      pcache_unlink(pc);
+      return pc;
+    }
+  }
+  if (!extra) {
+    return NULL;
+  }
+  pcpage_t *pc = slab_alloc(&pcextra_cache);
+  if (pc != NULL) {
+    pc->extra_next = pcextra;
+    pcextra = pc;
+  }
+  return pc;
+}
+
+static void *pcache_fill(inode_t *inode, uint32_t pgno) {
+  // read the page from disk, bytes beyond the end of file are zero
+  void *page = kalloc();
+  if (page == NULL) {
+    return NULL;
+  }
+  int n = iread_direct(inode, pgno * PGSIZE, page, PGSIZE);
+  assert(n >= 0);
+  memset((char*)page + n, 0, PGSIZE - n);
+  return page;
+}
+
+static pcpage_t *pcache_find(uint32_t no, uint32_t pgno) {
+  for (pcpage_t *pc = pchash[PCHASH(no, pgno)]; pc; pc = pc->next) {
+    if (pc->ino == no && pc->pgno == pgno) {
+      return pc;
+    }
+  }
+  return NULL;
+}
+
+static void *pcache_lookup(inode_t *inode, uint32_t pgno, int shared) {
+  uint32_t no = ino(inode);
+  pcpage_t *pc = pcache_find(no, pgno);
+  if (pc != NULL) {
+    return kdup(pc->page);
+  }
+  void *page = pcache_fill(inode, pgno);
+  if (page == NULL) {
+    return NULL;
+  }
+  pc = pcache_alloc(shared);
+  if (pc == NULL) {
+    // cache is full of pages in use, give a private one instead,
+    // never to a shared mapping, it would not see others' writes
+    if (shared) {
+      kfree(page);
+      return NULL;
+    }
+    return page;
+  }
+  pc->ino = no;
+  pc->pgno = pgno;
+  pc->page = page;
+  pc->next = pchash[PCHASH(no, pgno)];
+  pchash[PCHASH(no, pgno)] = pc;
+  return kdup(page);
+}
+
+void *pcache_get(inode_t *inode, uint32_t pgno) {
+  // return page pgno of inode with a reference for the caller,
+  // NULL if no memory, it may be a private copy if the cache is full
+  return pcache_lookup(inode, pgno, 0);
+}
+
+void *pcache_get_shared(inode_t *inode, uint32_t pgno) {
+  // like pcache_get, but always the cached page, for a shared mapping
+  return pcache_lookup(inode, pgno, 1);
+}
+
+int pcache_read(inode_t *inode, uint32_t off, void *buf, uint32_t len) {
+  // read [off, MIN(off+len, size)) of inode through the cache,
+  // return bytes read, -1 if no memory before any byte is read
+  uint32_t size = isize(inode);
+  if (off >= size) {
+    return 0;
+  }
+  len = MIN(len, size - off);
+  for (uint32_t done = 0; done < len; ) {
+    uint32_t pos = off + done, n = MIN(len - done, PGSIZE - pos % PGSIZE);
+    char *page = pcache_get(inode, pos / PGSIZE);
+    if (page == NULL) {
+      return done ? done : -1;
+    }
+    memcpy((char*)buf + done, page + pos % PGSIZE, n);
+    kfree(page);
+    done += n;
+  }
+  return len;
+}
+
+void pcache_write(inode_t *inode, uint32_t off, const void *buf, uint32_t len) {
+  // update cached pages of inode by what is written to [off, off+len),
+  // a page written back from itself is already the same
+  uint32_t no = ino(inode);
+  for (uint32_t pos = off; pos < off + len; pos = PAGE_DOWN(pos) + PGSIZE) {
+    pcpage_t *pc = pcache_find(no, pos / PGSIZE);
+    if (pc == NULL) {
+      continue;
+    }
+    uint32_t n = MIN(off + len - pos, PGSIZE - pos % PGSIZE);
+    const char *src = (const char*)buf + (pos - off);
+    char *dst = (char*)pc->page + pos % PGSIZE;
+    if (src != dst) {
+      memcpy(dst, src, n);
+    }
+  }
+}
+
+void pcache_drop(inode_t *inode) {
+  // forget cached pages of inode when its content changes,
+  // pages still mapped stay alive for their users
+  uint32_t no = ino(inode);
+  for (int i = 0; i < PCACHE_NUM; i++) {
+    if (pcpages[i].page != NULL && pcpages[i].ino == no) {
+      pcache_unlink(&pcpages[i]);
+    }
+  }
+  for (pcpage_t **pp = &pcextra; *pp != NULL; ) {
+    if ((*pp)->ino == no) {
+      pcextra_free(pp);
+    } else {
+      pp = &(*pp)->extra_next;
+    }
+  }
+}
@@ -1,46 +1,236 @@
 #include "klib.h"
 #include "cte.h"
 #include "proc.h"
-
-#define PROC_NUM 64
+#include "slab.h"
+#include "timer.h"
 
 static __attribute__((used)) int next_pid = 1;
 
-proc_t pcb[PROC_NUM];
-static proc_t *curr = &pcb[0];
+// proc0 is the kernel itself, and the head of the list of all procs
+static proc_t proc0;
+static proc_t *curr = &proc0;
+static slab_cache_t proc_cache = SLAB_CACHE("proc", proc_t, NULL);
+static int orphans; // zombies no one will wait, reaped at next proc_alloc
+static uint32_t cr3_load, cr3_skip; // switches that load CR3 or not
+
+#define for_each_proc(p) for (proc_t *p = proc0.next; p != &proc0; p = p->next)
+
+// MLFQ: a ready queue for each level, the lowest set bit of rq_bitmap is
+// the highest level having a READY proc. curr is in no queue, and proc0
+// never is, it only runs when no one else can.
+#define QUANTUM(prio) (1 << ((prio) / 2)) // ticks, longer at lower levels
+#define BOOST_TICKS   100 // move all procs back to their top level this often
+
+static proc_t *rq_head[NR_PRIO], *rq_tail[NR_PRIO];
+static uint32_t rq_bitmap;
+
+// EDF: real-time procs are in rt_list instead of ready queues. A job is
+// released every period, and can use runtime ticks before it is throttled
+// until the next release. A job not done by its deadline is a miss.
+#define RT_UTIL_MAX 900 // per mille of CPU real-time procs can reserve
+#define RT_UTIL(p)  ((p)->rt_runtime * 1000 / (p)->rt_deadline)
+#define RT_DUE(p)   ((p)->rt_start + (p)->rt_deadline)
+
+static proc_t *rt_list;
+static uint32_t rt_util; // per mille reserved by admitted procs
+
+// Hierarchical timer wheel: a proc blocked with a timeout due in less than
+// 64^(n+1) ticks is in level n, at the slot of its expire, whose slots span
+// 64^n ticks each. Each tick wakes all of one level 0 slot; when a level
+// wraps, the next slot of the level above cascades down into it, so a proc
+// moves at most TW_LEVELS - 1 times. Waking up by other means takes it out
+// in O(1).
+#define TW_BITS   6
+#define TW_SIZE   (1 << TW_BITS)
+#define TW_LEVELS 4 // spans 2^24 ticks, longer timeouts wait at the top
+#define TW_SLOT(expire, level) (((expire) >> ((level) * TW_BITS)) & (TW_SIZE - 1))
+
+static proc_t *tw_slot[TW_LEVELS][TW_SIZE];
+static uint32_t tw_now; // tick last fired
+
+static void rq_push(proc_t *proc) {
+  int prio = proc->prio;
+  proc->rq_next = NULL;
+  if (rq_tail[prio]) rq_tail[prio]->rq_next = proc;
+  else rq_head[prio] = proc;
+  rq_tail[prio] = proc;
+  rq_bitmap |= 1u << prio;
+}
+
+static proc_t *rq_pop() {
+  // take the first proc of the highest level, NULL if none
+  if (rq_bitmap == 0) {
+    return NULL;
+  }
+  int prio = __builtin_ctz(rq_bitmap);
+  proc_t *proc = rq_head[prio];
+  rq_head[prio] = proc->rq_next;
+  if (rq_head[prio] == NULL) {
+    rq_tail[prio] = NULL;
+    rq_bitmap &= ~(1u << prio);
+  }
+  return proc;
+}
+
+static proc_t *rt_pick() {
+  // READY real-time proc whose job has the earliest deadline, NULL if none
+  proc_t *best = NULL;
+  for (proc_t *p = rt_list; p; p = p->rt_next) {
+    if (p->status == READY && p->rt_finish == 0 && p->rt_used < p->rt_runtime &&
+        (best == NULL || RT_DUE(p) < RT_DUE(best))) {
+      best = p;
+    }
+  }
+  return best;
+}
+
+static void rt_tick(uint32_t now) {
+  // release new jobs of real-time procs whose period ends
+  for (proc_t *p = rt_list; p; p = p->rt_next) {
+    if (now < p->rt_start + p->rt_period) {
+      continue;
+    }
+    p->rt_jobs++;
+    if (p->rt_finish == 0 || p->rt_finish > RT_DUE(p)) {
+      p->rt_miss++;
+    }
+    p->rt_start = now - (now - p->rt_start) % p->rt_period;
+    p->rt_used = 0;
+    // a blocked one has no work to do in this job
+    p->rt_finish = p->status == BLOCKED ? now : 0;
+  }
+}
+
+static void rt_done(proc_t *proc) {
+  // proc gives up CPU by itself, its current job is done
+  if (proc->rt_period && proc->rt_finish == 0) {
+    proc->rt_finish = MAX(get_tick(), 1);
+  }
+}
+
+static void rt_leave(proc_t *proc) {
+  proc_t **pp = &rt_list;
+  while (*pp != proc) {
+    pp = &(*pp)->rt_next;
+  }
+  *pp = proc->rt_next;
+  rt_util -= RT_UTIL(proc);
+  proc->rt_period = 0;
+}
+
+static void tw_add(proc_t *proc, uint32_t expire) {
+  // expire is after tw_now, or equal to it when cascading in tw_fire
+  uint32_t delta = expire - tw_now, at = expire;
+  int level = 0;
+  while (level < TW_LEVELS - 1 && delta >> ((level + 1) * TW_BITS)) {
+    level++;
+  }
+  if (delta >> (TW_LEVELS * TW_BITS)) {
+    // beyond the wheel, cascaded down at its last slot and put back
+    at = tw_now + (1u << (TW_LEVELS * TW_BITS)) - 1;
+  }
+  proc_t **slot = &tw_slot[level][TW_SLOT(at, level)];
+  proc->tw_expire = expire;
+  proc->tw_next = *slot;
+  if (*slot) (*slot)->tw_pprev = &proc->tw_next;
+  proc->tw_pprev = slot;
+  *slot = proc;
+}
+
+static void tw_remove(proc_t *proc) {
+  *proc->tw_pprev = proc->tw_next;
+  if (proc->tw_next) proc->tw_next->tw_pprev = proc->tw_pprev;
+  proc->tw_pprev = NULL;
+}
+
+static void tw_fire(uint32_t now) {
+  // wake procs whose timeout is now, leaving the sem they wait in
+  tw_now = now;
+  for (int level = 1; level < TW_LEVELS && TW_SLOT(now, level - 1) == 0; level++) {
+    // level - 1 wrapped, spread the next slot of this level below
+    proc_t *p, **slot = &tw_slot[level][TW_SLOT(now, level)];
+    while ((p = *slot) != NULL) {
+      tw_remove(p);
+      tw_add(p, p->tw_expire);
+    }
+  }
+  for (proc_t *p = tw_slot[0][TW_SLOT(now, 0)], *next; p; p = next) {
+    next = p->tw_next;
+    if (p->wait_sem) {
+      sem_cancel(p->wait_sem, p->wait_entry);
+    }
+    p->timedout = 1;
+    proc_addready(p);
+  }
+}
+
+static void rq_boost() {
+  // move all procs to their top level, so the low ones won't starve
+  for (int prio = 1; prio < NR_PRIO; prio++) {
+    proc_t *p = rq_head[prio];
+    rq_head[prio] = rq_tail[prio] = NULL;
+    rq_bitmap &= ~(1u << prio);
+    while (p) {
+      proc_t *next = p->rq_next;
+      p->prio = p->nice;
+      p->ticks = 0;
+      rq_push(p);
+      p = next;
+    }
+  }
+  curr->prio = curr->nice;
+  curr->ticks = 0;
+}
 
 void init_proc() {
   // Lab2-1, set status and pgdir
   curr->status = RUNNING;
   curr->pgdir = vm_curr();
-  pcb[0].kstack = (void*)(KER_MEM - PGSIZE);
+  proc0.kstack = (void*)(KER_MEM - PGSIZE);
+  proc0.prev = proc0.next = &proc0;
   // Lab2-4, init zombie_sem
-  sem_init(&pcb[0].zombie_sem, 0);
+  sem_init(&proc0.zombie_sem, 0);
   // Lab3-2, set cwd
 }
 
-proc_t *proc_alloc() {
-  // Lab2-1: find a unused pcb from pcb[1..PROC_NUM-1], return NULL if no such one
-  // TODO();
-  proc_t *free_pcb = NULL;
-  for (int i = 1; i < PROC_NUM; i++) {
-    if (pcb[i].status == UNUSED) {
-      free_pcb = &pcb[i];
-      break;
+static void proc_reap() {
+  // free orphan zombies, they can not free themselves as curr
+  for (proc_t *p = proc0.next, *next; p != &proc0 && orphans > 0; p = next) {
+    next = p->next;
+    if (p->status == ZOMBIE && p->parent == NULL && p != curr) {
+      proc_free(p);
+      orphans--;
     }
   }
+}
+
+proc_t *proc_alloc() {
+  // Lab2-1: alloc a pcb from proc_cache, return NULL if no memory
+  // TODO();
+  proc_reap();
+  proc_t *free_pcb = slab_alloc(&proc_cache);
   if (free_pcb == NULL) {
     return NULL;
   }
+  free_pcb->pgdir = vm_alloc();
+  free_pcb->kstack = kalloc();
+  if (free_pcb->pgdir == NULL || free_pcb->kstack == NULL) {
+    kfree(free_pcb->pgdir);
+    kfree(free_pcb->kstack);
+    slab_free(&proc_cache, free_pcb);
+    return NULL;
+  }
   free_pcb->pid = next_pid;
   next_pid++;
   free_pcb->status = UNINIT;
-  free_pcb->pgdir = vm_alloc();
-  free_pcb->kstack = kalloc();
   free_pcb->brk = 0;
+  memset(free_pcb->vmas, 0, sizeof(free_pcb->vmas));
   free_pcb->ctx = &(free_pcb->kstack->ctx);
   free_pcb->child_num = 0;
   free_pcb->parent = NULL;
+  free_pcb->prio = free_pcb->nice = 0;
+  free_pcb->ticks = 0;
+  free_pcb->rt_period = 0;
   sem_init(&free_pcb->zombie_sem, 0);
 
   for (int i = 0; i < MAX_USEM; i++) {
@@ -50,6 +240,10 @@ proc_t *proc_alloc() {
   for (int i = 0; i < MAX_UFILE; i++) {
     free_pcb->files[i] = NULL;
   }
+  free_pcb->prev = proc0.prev;
+  free_pcb->next = &proc0;
+  proc0.prev->next = free_pcb;
+  proc0.prev = free_pcb;
   return free_pcb;
   // init ALL attributes of the pcb
 }
@@ -61,41 +255,177 @@ void proc_free(proc_t *proc) {
     return;
   }
   proc->status = UNUSED;
+  proc->prev->next = proc->next;
+  proc->next->prev = proc->prev;
+  vm_teardown(proc->pgdir);
+  kfree(proc->kstack);
+  slab_free(&proc_cache, proc);
 }
 
 proc_t *proc_curr() {
   return curr;
 }
 
+void proc_cr3info(uint32_t *load, uint32_t *skip) {
+  *load = cr3_load;
+  *skip = cr3_skip;
+}
+
+proc_t *proc_next(proc_t *proc) {
+  // next living proc after proc (the first if proc is NULL), NULL if none
+  for (proc_t *p = proc ? proc->next : proc0.next; p != &proc0; p = p->next) {
+    if (p->status != UNINIT && p->status != ZOMBIE) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+proc_t *proc_find(int pid) {
+  // find a living proc by pid, NULL if none
+  for_each_proc(p) {
+    if (p->pid == pid && p->status != UNINIT && p->status != ZOMBIE) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
 void proc_run(proc_t *proc) {
   proc->status = RUNNING;
   curr = proc;
-  set_cr3(proc->pgdir);
+  // loading CR3 flushes TLB, avoid it if the pgdir is in use already
+  if (vm_curr() != proc->pgdir) {
+    set_cr3(proc->pgdir);
+    cr3_load++;
+  } else {
+    cr3_skip++;
+  }
   set_tss(KSEL(SEG_KDATA), (uint32_t)STACK_TOP(proc->kstack));
   irq_iret(proc->ctx);
 }
 
 void proc_addready(proc_t *proc) {
   // Lab2-1: mark proc READY
+  // a new proc, or one waking up from I/O or sem, starts at its top level
+  if (proc->status == UNINIT || proc->status == BLOCKED) {
+    proc->prio = proc->nice;
+    proc->ticks = 0;
+  }
+  if (proc->status == BLOCKED && proc->rt_period) {
+    proc->rt_finish = 0; // has work again, the job goes on
+  }
+  if (proc->tw_pprev) {
+    tw_remove(proc);
+  }
+  proc->wait_sem = NULL;
   proc->status = READY;
+  if (proc != curr && proc->rt_period == 0) {
+    rq_push(proc);
+  }
 }
 
-void proc_yield() {
-  // Lab2-1: mark curr proc READY, then int $0x81
+static void proc_preempt() {
   curr->status = READY;
   INT(0x81);
 }
 
-void proc_copycurr(proc_t *proc) {
-  // Lab2-2: copy curr proc
+void proc_yield() {
+  // Lab2-1: mark curr proc READY, then int $0x81
+  rt_done(curr);
+  proc_preempt();
+}
+
+void proc_tick() {
+  // charge a timer tick to curr, preempt it when its quantum or budget is
+  // used up, or someone more urgent can run
+  uint32_t now = get_tick();
+  tw_fire(now);
+  rt_tick(now);
+  if (now % BOOST_TICKS == 0) {
+    rq_boost(); // also when idle or a real-time proc is running
+  }
+  proc_t *rt = rt_pick();
+  if (curr == &proc0) {
+    if (rt || rq_bitmap) proc_preempt();
+    return;
+  }
+  if (curr->rt_period) {
+    if (++curr->rt_used >= curr->rt_runtime || (rt && RT_DUE(rt) < RT_DUE(curr))) {
+      proc_preempt();
+    }
+    return;
+  }
+  if (++curr->ticks >= QUANTUM(curr->prio)) {
+    // used up the whole quantum, seems not interactive
+    curr->ticks = 0;
+    curr->prio = MIN(curr->prio + 1, NR_PRIO - 1);
+    proc_preempt();
+  } else if (rt || (rq_bitmap & ((1u << curr->prio) - 1))) {
+    proc_preempt();
+  }
+}
+
+int proc_setrt(uint32_t period, uint32_t runtime, uint32_t deadline) {
+  // make curr real-time, runtime ticks in each period, done in deadline
+  // ticks (period if 0) after release, period 0 makes it normal again
+  // return -1 if invalid, or admitting it would overload CPU
+  if (deadline == 0) {
+    deadline = period;
+  }
+  if (period != 0 && (runtime == 0 || runtime > deadline || deadline > period)) {
+    return -1;
+  }
+  uint32_t util = period ? runtime * 1000 / deadline : 0;
+  uint32_t old = curr->rt_period ? RT_UTIL(curr) : 0;
+  if (rt_util - old + util > RT_UTIL_MAX) {
+    return -1;
+  }
+  if (curr->rt_period) {
+    rt_leave(curr);
+  }
+  if (period != 0) {
+    curr->rt_period = period;
+    curr->rt_runtime = runtime;
+    curr->rt_deadline = deadline;
+    curr->rt_start = get_tick();
+    curr->rt_used = curr->rt_finish = 0;
+    curr->rt_jobs = curr->rt_miss = 0;
+    curr->rt_next = rt_list;
+    rt_list = curr;
+    rt_util += util;
+  }
+  return 0;
+}
+
+int proc_nice(int inc) {
+  // add inc to nice of curr, return the new one
+  curr->nice = MAX(0, MIN(curr->nice + inc, NR_PRIO - 1));
+  curr->prio = curr->nice;
+  curr->ticks = 0;
+  return curr->nice;
+}
+
+int proc_copycurr(proc_t *proc) {
+  // Lab2-2: copy curr proc, return -1 if no memory for its pages
   // TODO();
 
-  vm_copycurr(proc->pgdir);
+  if (vm_copycurr(proc->pgdir) != 0) {
+    return -1;
+  }
   proc->brk = curr->brk;
+  vma_dup(proc->vmas, curr->vmas);
   *(proc->ctx) = curr->kstack->ctx;
   proc->ctx->eax = 0;
+  proc_inherit(proc);
+  return 0;
+}
+
+void proc_inherit(proc_t *proc) {
+  // make proc a child of curr, sharing curr's opened usems and files
   proc->parent = curr;
   curr->child_num++;
+  proc->nice = curr->nice;
   // Lab2-5: dup opened usems
   for (int i = 0; i < MAX_USEM; i++) {
     if (curr->usems[i] == NULL) {
@@ -122,21 +452,34 @@ void proc_makezombie(proc_t *proc, int exitcode) {
   //TODO();
   proc->status = ZOMBIE;
   proc->exit_code = exitcode;
+  if (proc->rt_period) {
+    rt_leave(proc);
+  }
 
-  for (int i = 0; i < PROC_NUM; i++) {
-    if (pcb[i].parent == proc) {
-      pcb[i].parent = NULL;
+  for_each_proc(p) {
+    if (p->parent == proc) {
+      p->parent = NULL;
+      if (p->status == ZOMBIE) orphans++;
     }
   }
 
   if(proc->parent != NULL) {
     sem_v(&proc->parent->zombie_sem);
+  } else {
+    orphans++;
   }
-  
+
+  proc_release(proc);
+  // user memory is useless now, pgdir and kstack are freed by proc_free
+  vm_unmap(proc->pgdir, PHY_MEM, USR_MEM - PHY_MEM);
+}
+
+void proc_release(proc_t *proc) {
   // Lab2-5: close opened usem
   for (int i = 0; i < MAX_USEM; i++) {
     if (proc->usems[i] != NULL) {
       usem_close(proc->usems[i]);
+      proc->usems[i] = NULL;
     }
   }
   // Lab3-1: close opened files
@@ -144,17 +487,21 @@ void proc_makezombie(proc_t *proc, int exitcode) {
   {
     if(proc->files[i] != NULL)
       fclose(proc->files[i]);
+    proc->files[i] = NULL;
   }
   // Lab3-2: close cwd
 
+  // drop vmas, file vmas hold their inodes, shared ones are written back
+  vma_sync(proc->pgdir, proc->vmas);
+  vma_clear(proc->vmas);
 }
 
 proc_t *proc_findzombie(proc_t *proc) {
   // Lab2-3: find a ZOMBIE whose parent is proc, return NULL if none
   // TODO();
-  for (int i = 0; i < PROC_NUM; i++) {
-    if (pcb[i].parent == proc && pcb[i].status == ZOMBIE) {
-      return &pcb[i];
+  for_each_proc(p) {
+    if (p->parent == proc && p->status == ZOMBIE) {
+      return p;
     }
   }
   return NULL;
@@ -163,10 +510,20 @@ proc_t *proc_findzombie(proc_t *proc) {
 
 void proc_block() {
   // Lab2-4: mark curr proc BLOCKED, then int $0x81
+  rt_done(curr);
   curr->status = BLOCKED;
   INT(0x81);
 }
 
+int proc_timedblock(uint32_t ticks) {
+  // block curr until it is woken up, or ticks (> 0) have passed,
+  // return 1 if it is the latter
+  curr->timedout = 0;
+  tw_add(curr, get_tick() + ticks);
+  proc_block();
+  return curr->timedout;
+}
+
 int proc_allocusem(proc_t *proc) {
   // Lab2-5: find a free slot in proc->usems, return its index, or -1 if none
   // TODO();
@@ -211,11 +568,14 @@ void schedule(Context *ctx) {
   // Lab2-1: save ctx to curr->ctx, then find a READY proc and run it
   //TODO();
   curr->ctx = ctx;
-  int temp = curr - pcb;
-  for (int i = 1; i <= PROC_NUM; i++) {
-    if (pcb[(temp + i) % PROC_NUM].status == READY) {
-      proc_run(&pcb[(temp + i) % PROC_NUM]);
-    }
+  // curr goes to the tail of its level, round robin inside a level
+  if (curr->status == READY && curr != &proc0 && curr->rt_period == 0) {
+    rq_push(curr);
   }
-
+  // real-time ones first, by EDF
+  proc_t *p = rt_pick();
+  if (p == NULL) {
+    p = rq_pop();
+  }
+  proc_run(p ? p : &proc0);
 }
@@ -1,6 +1,7 @@
 #include "klib.h"
 #include "sem.h"
 #include "proc.h"
+#include "slab.h"
 
 void sem_init(sem_t *sem, int value) {
   sem->value = value;
@@ -26,20 +27,41 @@ void sem_v(sem_t *sem) {
   }
 }
 
-#define USER_SEM_NUM 128
-static usem_t user_sem[USER_SEM_NUM] __attribute__((used));
+int sem_p_timeout(sem_t *sem, uint32_t ticks) {
+  // like sem_p, but give up after ticks, return -1 if so
+  if (sem->value <= 0 && ticks == 0) {
+    return -1;
+  }
+  sem->value--;
+  if (sem->value < 0) {
+    proc_t *proc = proc_curr();
+    proc->wait_sem = sem;
+    proc->wait_entry = list_enqueue(&sem->wait_list, proc);
+    if (proc_timedblock(ticks)) {
+      return -1; // the timer has taken it out of wait_list
+    }
+  }
+  return 0;
+}
+
+void sem_cancel(sem_t *sem, list_t *entry) {
+  // a waiter times out, undo its sem_p
+  list_remove(&sem->wait_list, entry);
+  sem->value++;
+}
+
+static slab_cache_t usem_cache = SLAB_CACHE("usem", usem_t, NULL);
 
 usem_t *usem_alloc(int value) {
-  // Lab2-5: find a usem whose ref==0, init it, inc ref and return it, return NULL if none
+  // Lab2-5: alloc a usem from usem_cache, init it, inc ref and return it, return NULL if no memory
   // TODO();
-  for (int i = 0; i < USER_SEM_NUM; i++) {
-    if (user_sem[i].ref == 0) {
-      sem_init(&user_sem[i].sem, value);
-      user_sem[i].ref++;
-      return &user_sem[i];
-    }
+  usem_t *usem = slab_alloc(&usem_cache);
+  if (usem == NULL) {
+    return NULL;
   }
-  return NULL;
+  sem_init(&usem->sem, value);
+  usem->ref++;
+  return usem;
 }
 
 usem_t *usem_dup(usem_t *usem) {
@@ -53,6 +75,9 @@ void usem_close(usem_t *usem) {
   // Lab2-5: dec usem's ref
   // TODO();
   usem->ref--;
+  if (usem->ref == 0) {
+    slab_free(&usem_cache, usem);
+  }
 }
 
 
@@ -0,0 +1,82 @@
+#include "klib.h"
+#include "vme.h"
+#include "slab.h"
+#include "shm.h"
+
+// Shared memory segments. A segment holds a reference of each of its
+// frames and every PTE mapping one holds another, so a frame lives until
+// the segment is closed by its last vma and no PTE maps it.
+
+static slab_cache_t shm_cache = SLAB_CACHE("shm", shm_t, NULL);
+static shm_t *named; // named segments, so others can open them
+
+shm_t *shm_open(const char *name, uint32_t npage) {
+  // open segment of name with npage pages at least, create it if not exist,
+  // a NULL name creates an anonymous one, return NULL if fail
+  if (name != NULL) {
+    for (shm_t *shm = named; shm; shm = shm->next) {
+      if (strcmp(shm->name, name) == 0) {
+        return npage <= shm->npage ? shm_dup(shm) : NULL;
+      }
+    }
+  }
+  if (npage == 0 || npage > SHM_MAXPG) {
+    return NULL;
+  }
+  shm_t *shm = slab_alloc(&shm_cache);
+  if (shm == NULL) {
+    return NULL;
+  }
+  shm->pages = kalloc_zeroed();
+  if (shm->pages == NULL) {
+    slab_free(&shm_cache, shm);
+    return NULL;
+  }
+  shm->npage = npage;
+  shm->ref = 1;
+  if (name != NULL) {
+    strncpy(shm->name, name, SHM_NAME);
+    shm->next = named;
+    named = shm;
+  }
+  return shm;
+}
+
+shm_t *shm_dup(shm_t *shm) {
+  shm->ref++;
+  return shm;
+}
+
+void shm_close(shm_t *shm) {
+  // free the segment with its frames when no vma uses it,
+  // a name is free to create a new one then
+  assert(shm->ref > 0);
+  if (--shm->ref > 0) {
+    return;
+  }
+  if (shm->name[0]) {
+    shm_t **pp = &named;
+    while (*pp != shm) {
+      pp = &(*pp)->next;
+    }
+    *pp = shm->next;
+  }
+  for (uint32_t i = 0; i < shm->npage; i++) {
+    kfree(shm->pages[i]);
+  }
+  kfree(shm->pages);
+  slab_free(&shm_cache, shm);
+}
+
+void *shm_page(shm_t *shm, uint32_t pgno) {
+  // return frame pgno of the segment with a reference for the caller,
+  // alloc it at the first touch, NULL if no memory
+  assert(pgno < shm->npage);
+  if (shm->pages[pgno] == NULL) {
+    shm->pages[pgno] = kalloc_zeroed();
+    if (shm->pages[pgno] == NULL) {
+      return NULL;
+    }
+  }
+  return kdup(shm->pages[pgno]);
+}
@@ -0,0 +1,89 @@
+#include "klib.h"
+#include "vme.h"
+#include "slab.h"
+
+// A slab is one page, a header followed by objects of its cache.
+// Free objects are linked through their first word, so alloc and free
+// are O(1) unless a new slab is needed. A slab whose objects are all
+// freed goes back to kalloc, except the last partial one of the cache.
+
+typedef struct slab {
+  slab_cache_t *cache;
+  struct slab *prev, *next; // in partial or full list of cache
+  void *free; // free objects
+  size_t inuse;
+} slab_t;
+
+#define OBJ_SIZE(cache)  (((cache)->size + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+#define SLAB_OBJS(cache) ((PGSIZE - sizeof(slab_t)) / OBJ_SIZE(cache))
+
+static void slab_push(slab_t **list, slab_t *slab) {
+  slab->prev = NULL;
+  slab->next = *list;
+  if (slab->next) slab->next->prev = slab;
+  *list = slab;
+}
+
+static void slab_unlink(slab_t **list, slab_t *slab) {
+  if (slab->prev) slab->prev->next = slab->next;
+  else *list = slab->next;
+  if (slab->next) slab->next->prev = slab->prev;
+}
+
+static slab_t *slab_grow(slab_cache_t *cache) {
+  assert(OBJ_SIZE(cache) <= PGSIZE - sizeof(slab_t));
+  slab_t *slab = kalloc();
+  if (slab == NULL) {
+    return NULL;
+  }
+  slab->cache = cache;
+  slab->free = NULL;
+  slab->inuse = 0;
+  char *obj = (char*)(slab + 1);
+  for (size_t i = 0; i < SLAB_OBJS(cache); i++, obj += OBJ_SIZE(cache)) {
+    *(void**)obj = slab->free;
+    slab->free = obj;
+  }
+  slab_push(&cache->partial, slab);
+  cache->nslab++;
+  return slab;
+}
+
+void *slab_alloc(slab_cache_t *cache) {
+  // return a new object inited by ctor (zero filled if no ctor), NULL if no memory
+  slab_t *slab = cache->partial;
+  if (slab == NULL && (slab = slab_grow(cache)) == NULL) {
+    return NULL;
+  }
+  void *obj = slab->free;
+  slab->free = *(void**)obj;
+  if (++slab->inuse == SLAB_OBJS(cache)) {
+    slab_unlink(&cache->partial, slab);
+    slab_push(&cache->full, slab);
+  }
+  cache->inuse++;
+  if (cache->ctor) {
+    cache->ctor(obj);
+  } else {
+    memset(obj, 0, cache->size);
+  }
+  return obj;
+}
+
+void slab_free(slab_cache_t *cache, void *obj) {
+  slab_t *slab = (slab_t*)PAGE_DOWN(obj);
+  assert(slab->cache == cache && slab->inuse > 0);
+  if (slab->inuse == SLAB_OBJS(cache)) {
+    slab_unlink(&cache->full, slab);
+    slab_push(&cache->partial, slab);
+  }
+  *(void**)obj = slab->free;
+  slab->free = obj;
+  slab->inuse--;
+  cache->inuse--;
+  if (slab->inuse == 0 && (slab->prev || slab->next)) {
+    slab_unlink(&cache->partial, slab);
+    kfree(slab);
+    cache->nslab--;
+  }
+}
@@ -0,0 +1,149 @@
+#include "klib.h"
+#include "vme.h"
+#include "proc.h"
+#include "disk.h"
+#include "swap.h"
+
+// Swap area on disk, one page per slot. A swapped out PTE is not present,
+// has PTE_SWAP with its W/U/COW bits kept and the slot in its frame.
+// Forked PTEs share the slot, so slots are reference counted.
+
+#define MAX_SLOT  32768 // 128 MiB at most
+#define SWAP_PROT (PTE_W | PTE_U | PTE_COW)
+
+#define PTE2SLOT(pte) ((pte).val >> PGBITS)
+
+static uint32_t swap_sect, nslot, used_slot;
+static uint16_t slot_ref[MAX_SLOT];
+static uint32_t next_slot; // where to look for a free slot
+
+// clock hand of reclaimer, proc and va to scan next
+static int hand_pid;
+static size_t hand_va = PHY_MEM;
+
+void init_swap(uint32_t sect, uint32_t npage) {
+  swap_sect = sect;
+  nslot = MIN(npage, MAX_SLOT);
+}
+
+static int slot_alloc() {
+  for (uint32_t i = 0; i < nslot; i++) {
+    uint32_t slot = (next_slot + i) % nslot;
+    if (slot_ref[slot] == 0) {
+      slot_ref[slot] = 1;
+      used_slot++;
+      next_slot = slot + 1;
+      return slot;
+    }
+  }
+  return -1;
+}
+
+static uint32_t slot_off(uint32_t slot) {
+  return (swap_sect + slot * (PGSIZE / SECTSIZE)) * SECTSIZE;
+}
+
+void swap_dup(PTE pte) {
+  slot_ref[PTE2SLOT(pte)]++;
+}
+
+void swap_drop(PTE pte) {
+  uint32_t slot = PTE2SLOT(pte);
+  assert(slot_ref[slot] > 0);
+  if (--slot_ref[slot] == 0) {
+    used_slot--;
+  }
+}
+
+int swap_in(PTE *pte) {
+  // read a swapped out page back to memory, return 0 if no memory
+  void *page = kalloc();
+  if (page == NULL) {
+    return 0;
+  }
+  PTE old = *pte;
+  copy_from_disk(page, PGSIZE, slot_off(PTE2SLOT(old)));
+  pte->val = MAKE_PTE(page, old.val & SWAP_PROT);
+  swap_drop(old);
+  return 1;
+}
+
+static int swap_scan(proc_t *proc, int npage) {
+  // scan proc from hand_va, page out cold anonymous pages owned by it only,
+  // pages accessed since last scan get their accessed bit cleared instead
+  PD *pgdir = proc->pgdir;
+  int freed = 0, flush = 0;
+  for (; hand_va < USR_MEM && freed < npage; hand_va += PGSIZE) {
+    PDE *pde = &pgdir->pde[ADDR2DIR(hand_va)];
+    if (!pde->present || (pde->val & PTE_PS)) {
+      // skip the whole empty page table, or huge page which stays in memory
+      hand_va = PAGE_DOWN(hand_va | (PT_SIZE - 1));
+      continue;
+    }
+    PTE *pte = &PDE2PT(*pde)->pte[ADDR2TBL(hand_va)];
+    if (!pte->present || kref(PTE2PG(*pte)) > 1) {
+      continue;
+    }
+    vma_t *vma = vma_find(proc->vmas, hand_va);
+    if (vma == NULL || vma->inode != NULL) {
+      continue;
+    }
+    flush = 1;
+    if (pte->accessed) {
+      pte->val &= ~PTE_A;
+      continue;
+    }
+    int slot = slot_alloc();
+    if (slot < 0) {
+      break;
+    }
+    copy_to_disk(PTE2PG(*pte), PGSIZE, slot_off(slot));
+    kfree(PTE2PG(*pte));
+    pte->val = (slot << PGBITS) | PTE_SWAP | (pte->val & SWAP_PROT);
+    freed++;
+  }
+  if (flush && pgdir == vm_curr()) {
+    flush_tlb();
+  }
+  return freed;
+}
+
+int swap_reclaim(int npage) {
+  // page out at most npage pages like a clock going round all procs,
+  // return how many pages are freed
+  static int reclaiming;
+  if (nslot == used_slot || reclaiming) {
+    return 0;
+  }
+  reclaiming = 1;
+  int freed = 0;
+  proc_t *proc = proc_find(hand_pid);
+  if (proc == NULL) {
+    proc = proc_next(NULL);
+    hand_va = PHY_MEM;
+  }
+  // twice round at most, the first may only clear accessed bits
+  proc_t *start = proc;
+  for (int laps = 0; proc != NULL; ) {
+    freed += swap_scan(proc, npage - freed);
+    if (freed >= npage || nslot == used_slot) {
+      break;
+    }
+    proc = proc_next(proc);
+    if (proc == NULL) {
+      proc = proc_next(NULL); // wrap around
+    }
+    hand_va = PHY_MEM;
+    if (proc == start && ++laps == 2) {
+      break;
+    }
+  }
+  hand_pid = proc ? proc->pid : 0;
+  reclaiming = 0;
+  return freed;
+}
+
+void swap_info(uint32_t *total, uint32_t *used) {
+  *total = nslot;
+  *used = used_slot;
+}
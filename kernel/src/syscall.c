@@ -7,6 +7,7 @@
 #include "proc.h"
 #include "timer.h"
 #include "file.h"
+#include "shm.h"
 
 typedef int (*syshandle_t)(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
 
@@ -51,45 +52,58 @@ int sys_read(int fd, void *buf, size_t count) {
 
 int sys_brk(void *addr) {
   // TODO: Lab1-5
-  size_t brk = proc_curr()->brk; // use brk of proc instead of this in Lab2-1
+  // heap pages are zero filled on demand, so only the heap vma moves here
+  proc_t *proc = proc_curr();
+  size_t brk = proc->brk; // use brk of proc instead of this in Lab2-1
   size_t new_brk = PAGE_UP(addr);
+  vma_t *heap = vma_type(proc->vmas, VMA_HEAP);
   if (brk == 0) {
-    proc_curr()->brk = new_brk;
+    // the heap starts empty here
+    if (vma_add(proc->vmas, new_brk, new_brk, 7, VMA_HEAP) == NULL) return -1;
+    proc->brk = new_brk;
   } else if (new_brk > brk) {
-    PD *cur = vm_curr();
-    vm_map(cur, brk, new_brk-brk, 7);
-    proc_curr()->brk = new_brk;
+    if (new_brk > MMAP_BASE) return -1;
+    heap->end = new_brk;
+    proc->brk = new_brk;
   } else if (new_brk < brk) {
-    // can just do nothing
+    if (new_brk < heap->start) return -1;
+    // fails if a huge page has to be split but no memory
+    if (vm_unmap(vm_curr(), new_brk, brk - new_brk) != 0) return -1;
+    heap->end = new_brk;
+    proc->brk = new_brk;
   }
   return 0;
 }
 
 void sys_sleep(int ticks) {
   // TODO(); // Lab1-7
-  uint32_t now = get_tick();
-  while (get_tick() < now + ticks) {
-    // sti(); 
-    // hlt(); 
-    // cli();
-    proc_yield();
+  // blocked in the timer wheel, nothing else wakes it up
+  if (ticks > 0) {
+    proc_timedblock(ticks);
   }
-  
 }
 
 int sys_exec(const char *path, char *const argv[]) {
   //TODO(); // Lab1-8, Lab2-1
   PD *pd = vm_alloc();
+  if (pd == NULL) {
+    return -1;
+  }
+  vma_t vmas[MAX_VMA];
   Context ctx;
-  int ret = load_user(pd, &ctx, path, argv);
+  int ret = load_user(pd, vmas, &ctx, path, argv);
   if (ret != 0) {
-    kfree(pd);
+    vm_teardown(pd);
     return -1;
   }
   PD *now_pd = vm_curr();
   set_cr3(pd);
   proc_curr()->pgdir=pd;
-  kfree(now_pd);
+  proc_curr()->brk = 0;
+  vma_sync(now_pd, proc_curr()->vmas);
+  vma_clear(proc_curr()->vmas);
+  memcpy(proc_curr()->vmas, vmas, sizeof(vmas));
+  vm_teardown(now_pd);
   irq_iret(&ctx);
   return 0;
 }
@@ -108,7 +122,10 @@ int sys_fork() {
   if (pcb == NULL) {
     return -1;
   }
-  proc_copycurr(pcb);
+  if (proc_copycurr(pcb) != 0) {
+    proc_free(pcb);
+    return -1;
+  }
   proc_addready(pcb);
   return pcb->pid;
 }
@@ -164,6 +181,14 @@ int sys_sem_p(int sem_id) {
   return 0;
 }
 
+int sys_sem_p_timeout(int sem_id, int ticks) {
+  usem_t *sem = proc_getusem(proc_curr(), sem_id);
+  if (sem == NULL || ticks < 0) {
+    return -1;
+  }
+  return sem_p_timeout(&sem->sem, ticks);
+}
+
 int sys_sem_v(int sem_id) {
   // TODO(); // Lab2-5
   usem_t *sem = proc_getusem(proc_curr(), sem_id);
@@ -269,12 +294,42 @@ int sys_unlink(const char *path) {
 
 // optional syscall
 
-void *sys_mmap() {
-  TODO();
-}
-
-void sys_munmap(void *addr) {
-  TODO();
+void *sys_mmap(int fd, uint32_t off, size_t len, int prot, int flags) {
+  // map [off, off+len) of file fd lazily, pages come from its page cache
+  proc_t *proc = proc_curr();
+  file_t *file = proc_getfile(proc, fd);
+  if (file == NULL || file->type != TYPE_FILE || !file->readable) return MAP_FAILED;
+  if (ADDR2OFF(off) != 0 || len == 0 || len > MMAP_LIMIT) return MAP_FAILED;
+  if (flags != MAP_SHARED && flags != MAP_PRIVATE) return MAP_FAILED;
+  // writes of a shared mapping go back to file
+  if ((prot & PROT_WRITE) && flags == MAP_SHARED && !file->writable) return MAP_FAILED;
+  len = PAGE_UP(len);
+  size_t start = vma_gap(proc->vmas, len);
+  if (start == 0) return MAP_FAILED;
+  int pte_prot = PTE_P | PTE_U | ((prot & PROT_WRITE) ? PTE_W : 0);
+  vma_t *vma = vma_add(proc->vmas, start, start + len, pte_prot,
+                       flags == MAP_SHARED ? VMA_SHARED : VMA_FILE);
+  if (vma == NULL) return MAP_FAILED;
+  vma->inode = idup(file->inode);
+  vma->off = off;
+  return (void*)start;
+}
+
+int sys_munmap(void *addr, size_t len) {
+  // unmap [addr, addr+len) of one file or shared memory mapping,
+  // write back shared file pages
+  proc_t *proc = proc_curr();
+  size_t start = (size_t)addr, end = start + PAGE_UP(len);
+  vma_t *vma = vma_find(proc->vmas, start);
+  if (ADDR2OFF(start) != 0 || len == 0 || vma == NULL || end > vma->end) return -1;
+  if (vma->type != VMA_FILE && vma->type != VMA_SHARED && vma->type != VMA_SHM) return -1;
+  if (vma->type == VMA_SHARED) {
+    vm_msync(proc->pgdir, vma, start, end);
+  }
+  // cut vma first, it may fail when a split needs a new vma
+  if (vma_cut(proc->vmas, vma, start, end) != 0) return -1;
+  vm_unmap(proc->pgdir, start, end - start);
+  return 0;
 }
 
 int sys_clone(void (*entry)(void*), void *stack, void *arg) {
@@ -317,6 +372,152 @@ int sys_symlink(const char *oldpath, const char *newpath) {
   TODO();
 }
 
+// extended syscall
+
+int sys_getdents(int fd, struct dirent_stat *buf, int count, int flags) {
+  file_t *file = proc_getfile(proc_curr(), fd);
+  if (file == NULL || file->type != TYPE_FILE || !file->readable) {
+    return -1;
+  }
+  return igetdents(file->inode, &file->offset, buf, count, flags);
+}
+
+int sys_sendfile(int out_fd, int in_fd, uint32_t count) {
+  file_t *out = proc_getfile(proc_curr(), out_fd);
+  file_t *in = proc_getfile(proc_curr(), in_fd);
+  if (out == NULL || in == NULL) {
+    return -1;
+  }
+  return fsendfile(out, in, count);
+}
+
+int sys_readv(int fd, const struct iovec *iov, int iovcnt) {
+  file_t *file = proc_getfile(proc_curr(), fd);
+  if (file == NULL || iovcnt < 0 || iovcnt > IOV_MAX) {
+    return -1;
+  }
+  return freadv(file, iov, iovcnt);
+}
+
+int sys_writev(int fd, const struct iovec *iov, int iovcnt) {
+  file_t *file = proc_getfile(proc_curr(), fd);
+  if (file == NULL || iovcnt < 0 || iovcnt > IOV_MAX) {
+    return -1;
+  }
+  return fwritev(file, iov, iovcnt);
+}
+
+static int spawn_action(proc_t *proc, const struct spawn_action *act) {
+  // apply act to proc's fd table, as if proc itself called close/dup/open
+  file_t *file;
+  int fd;
+  switch (act->type) {
+    case SA_CLOSE:
+      file = proc_getfile(proc, act->fd);
+      if (file == NULL) return -1;
+      fclose(file);
+      proc->files[act->fd] = NULL;
+      return 0;
+    case SA_DUP:
+      file = proc_getfile(proc, act->fd);
+      fd = proc_allocfile(proc);
+      if (file == NULL || fd == -1) return -1;
+      proc->files[fd] = fdup(file);
+      return 0;
+    case SA_OPEN:
+      fd = proc_allocfile(proc);
+      if (fd == -1) return -1;
+      file = fopen(act->path, act->mode);
+      if (file == NULL) return -1;
+      fseek(file, 0, act->whence);
+      proc->files[fd] = file;
+      return 0;
+  }
+  return -1;
+}
+
+int sys_spawn(const char *path, char *const argv[], const struct spawn_action *acts) {
+  // build the child from the elf directly, never copy curr's memory
+  // return -1 if path cannot be loaded, or -2-i if the i-th action fails
+  proc_t *proc = proc_alloc();
+  if (proc == NULL) {
+    return -1;
+  }
+  proc_inherit(proc);
+  int ret = 0;
+  for (int i = 0; acts != NULL && acts[i].type != SA_END; i++) {
+    if (spawn_action(proc, &acts[i]) != 0) {
+      ret = -2 - i;
+      break;
+    }
+  }
+  if (ret == 0 && load_user(proc->pgdir, proc->vmas, proc->ctx, path, argv) != 0) {
+    ret = -1;
+  }
+  if (ret != 0) {
+    proc_release(proc);
+    proc->parent = NULL;
+    proc_curr()->child_num--;
+    proc_free(proc);
+    return ret;
+  }
+  proc_addready(proc);
+  return proc->pid;
+}
+
+int sys_meminfo(int pid, struct meminfo *mi) {
+  // usage of whole memory, and resident pages of proc pid (0 for curr)
+  proc_t *proc = pid == 0 ? proc_curr() : proc_find(pid);
+  if (proc == NULL) return -1;
+  kmeminfo(mi);
+  proc_cr3info(&mi->cr3_load, &mi->cr3_skip);
+  mi->rss = vm_resident(proc->pgdir);
+  return 0;
+}
+
+void *sys_shmat(const char *name, size_t len) {
+  // map len of the shared memory segment of name, create it if not exist,
+  // a NULL name creates an anonymous one which children share after fork
+  proc_t *proc = proc_curr();
+  if (len == 0 || len > SHM_MAXPG * PGSIZE) return MAP_FAILED;
+  if (name != NULL && (name[0] == '\0' || strlen(name) > SHM_NAME)) return MAP_FAILED;
+  len = PAGE_UP(len);
+  size_t start = vma_gap(proc->vmas, len);
+  if (start == 0) return MAP_FAILED;
+  vma_t *vma = vma_add(proc->vmas, start, start + len, 7, VMA_SHM);
+  if (vma == NULL) return MAP_FAILED;
+  vma->shm = shm_open(name, len / PGSIZE);
+  if (vma->shm == NULL) {
+    vma_cut(proc->vmas, vma, start, start + len);
+    return MAP_FAILED;
+  }
+  return (void*)start;
+}
+
+int sys_nice(int inc) {
+  // lower (or raise if inc < 0) the top scheduling level of curr
+  return proc_nice(inc);
+}
+
+int sys_sched_rt(uint32_t period, uint32_t runtime, uint32_t deadline) {
+  // declare curr real-time, or normal again if period is 0
+  return proc_setrt(period, runtime, deadline);
+}
+
+int sys_schedinfo(int pid, struct schedinfo *si) {
+  // scheduling state of proc pid (0 for curr)
+  proc_t *proc = pid == 0 ? proc_curr() : proc_find(pid);
+  if (proc == NULL) return -1;
+  si->prio = proc->prio;
+  si->nice = proc->nice;
+  si->period = proc->rt_period;
+  si->runtime = proc->rt_runtime;
+  si->deadline = proc->rt_deadline;
+  si->jobs = proc->rt_jobs;
+  si->miss = proc->rt_miss;
+  return 0;
+}
+
 void *syscall_handle[NR_SYS] = {
   [SYS_write] = sys_write,
   [SYS_read] = sys_read,
@@ -350,4 +551,15 @@ void *syscall_handle[NR_SYS] = {
   [SYS_cv_close] = sys_cv_close,
   [SYS_pipe] = sys_pipe,
   [SYS_link] = sys_link,
-  [SYS_symlink] = sys_symlink};
+  [SYS_symlink] = sys_symlink,
+  [SYS_getdents] = sys_getdents,
+  [SYS_sendfile] = sys_sendfile,
+  [SYS_readv] = sys_readv,
+  [SYS_writev] = sys_writev,
+  [SYS_spawn] = sys_spawn,
+  [SYS_meminfo] = sys_meminfo,
+  [SYS_shmat] = sys_shmat,
+  [SYS_nice] = sys_nice,
+  [SYS_sched_rt] = sys_sched_rt,
+  [SYS_schedinfo] = sys_schedinfo,
+  [SYS_sem_p_timeout] = sys_sem_p_timeout};
@@ -1,6 +1,11 @@
 #include "klib.h"
 #include "vme.h"
 #include "proc.h"
+#include "fs.h"
+#include "pcache.h"
+#include "swap.h"
+#include "ksm.h"
+#include "shm.h"
 
 static TSS32 tss;
 
@@ -23,15 +28,122 @@ void set_tss(uint32_t ss0, uint32_t esp0)
 }
 
 static PD kpd;
-static PT kpt[PHY_MEM / PT_SIZE] __attribute__((used));
+static PT kpt0; // [0, 4 MiB) in 4 KiB pages, to leave page 0 unmapped
 
+// Buddy allocator of [KER_MEM, phy_top): a free block of order n is 2^n
+// pages, aligned to its size, and its buddy is the block next to it which
+// makes a block of order n+1 together
 typedef union free_page
 {
-  union free_page *next;
+  struct {
+    union free_page *next, *prev; // in the free list of its order
+  };
   char buf[PGSIZE];
 } page_t;
 
-page_t *free_page_list;
+static page_t *free_area[MAX_ORDER + 1];
+static size_t free_count[MAX_ORDER + 1]; // free blocks of each order
+static size_t total_pages; // pages of RAM in [KER_MEM, phy_top)
+static size_t phy_top; // end of the highest RAM under PHY_MEM
+
+// physical page descriptor, one for each page under phy_top
+typedef struct {
+  uint32_t ref : 24; // users of the page, free it when drop to 0
+  uint32_t order : 4; // order of the block it heads
+  uint32_t free : 1;  // head of a free block
+  uint32_t sum;       // content checksum at the last same page merging scan
+} pgdesc_t;
+
+// sized from the memory map, so kept in RAM above KER_MEM by init_page
+static pgdesc_t *pgdesc;
+
+#define PA2DESC(pa) (&pgdesc[(uint32_t)(pa) >> PGBITS])
+#define BUDDY(pa, order) ((page_t *)((uint32_t)(pa) ^ (PGSIZE << (order))))
+
+// all zero page, mapped read only for reads of untouched anonymous memory
+static void *zero_page;
+
+#define SWAP_BATCH 32 // pages to page out once memory is full
+#define INVLPG_MAX 32 // unmap more pages than it flushes whole TLB
+
+// pool of zero filled pages, refilled by the idle loop
+#define ZPOOL_SIZE 64
+static void *zpool[ZPOOL_SIZE];
+static int zpool_num;
+static uint32_t zpool_hit, zpool_miss;
+
+static uint32_t huge_alloc; // user huge pages ever mapped
+
+static void buddy_push(page_t *page, int order)
+{
+  PA2DESC(page)->order = order;
+  PA2DESC(page)->free = 1;
+  page->prev = NULL;
+  page->next = free_area[order];
+  if (page->next) page->next->prev = page;
+  free_area[order] = page;
+  free_count[order]++;
+}
+
+static void buddy_remove(page_t *page, int order)
+{
+  PA2DESC(page)->free = 0;
+  if (page->prev) page->prev->next = page->next;
+  else free_area[order] = page->next;
+  if (page->next) page->next->prev = page->prev;
+  free_count[order]--;
+}
+
+static void buddy_free(page_t *page, int order)
+{
+  // merge with free buddies as far as possible
+  while (order < MAX_ORDER) {
+    page_t *buddy = BUDDY(page, order);
+    if ((uint32_t)buddy < KER_MEM || (uint32_t)buddy >= phy_top) break;
+    pgdesc_t *desc = PA2DESC(buddy);
+    if (!desc->free || desc->order != order) break;
+    buddy_remove(buddy, order);
+    page = MIN(page, buddy);
+    order++;
+  }
+  buddy_push(page, order);
+}
+
+static void buddy_add(size_t start, size_t end)
+{
+  // give [start, end) to the allocator,
+  // cut it into the largest blocks that are aligned to their size
+  for (size_t pa = start; pa < end; ) {
+    int order = MAX_ORDER;
+    while ((pa & ((PGSIZE << order) - 1)) || pa + (PGSIZE << order) > end) {
+      order--;
+    }
+    buddy_push((page_t *)pa, order);
+    pa += PGSIZE << order;
+    total_pages += 1 << order;
+  }
+}
+
+static int ram_range(int i, size_t *start, size_t *end)
+{
+  // [start, end) of the ith entry of BIOS memory map clipped to
+  // [KER_MEM, PHY_MEM), 0 if it is not RAM there;
+  // without a map, the only entry is the 128 MiB of a default QEMU
+  E820Map *map = (E820Map *)E820_MAP;
+  if (map->num == 0 || map->num > E820_MAX) {
+    *start = KER_MEM;
+    *end = 0x08000000;
+    return i == 0;
+  }
+  E820Entry *e = &map->entry[i];
+  if (i >= map->num || e->type != E820_RAM || e->base >= PHY_MEM) {
+    return 0;
+  }
+  uint64_t top = e->base + e->len;
+  *start = MAX(PAGE_UP(e->base), KER_MEM);
+  *end = top >= PHY_MEM ? PHY_MEM : PAGE_DOWN(top);
+  return *start < *end;
+}
 
 void init_page()
 {
@@ -42,47 +154,103 @@ void init_page()
   static_assert(sizeof(PT) == PGSIZE, "PT must be one page");
   static_assert(sizeof(PD) == PGSIZE, "PD must be one page");
   // Lab1-4: init kpd and kpt, identity mapping of [0 (or 4096), PHY_MEM)
-  for (int i = 0; i < PHY_MEM / PT_SIZE; i++)
+  // the first 4 MiB uses kpt0 for the null page guard, the rest 4 MiB pages
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, &eax, &ebx, &ecx, &edx);
+  panic_on(!(edx & CPUID_PSE), "CPU has no PSE");
+  // kernel map is same in all pgdirs, make it global if possible
+  int global = (edx & CPUID_PGE) ? PTE_G : 0;
+  set_cr4(get_cr4() | CR4_PSE);
+  kpd.pde[0].val = MAKE_PDE((uint32_t)(&kpt0), 3);
+  for (int j = 1; j < NR_PTE; j++)
   {
-    kpd.pde[i].val = MAKE_PDE((uint32_t)(&kpt[i]), 3); // Assuming kernel space is accessible in supervisor mode
-    for (int j = 0; j < NR_PTE; j++)
-    {
-      kpt[i].pte[j].val = MAKE_PTE((i << DIR_SHIFT) | (j << TBL_SHIFT), 3);
-    }
+    kpt0.pte[j].val = MAKE_PTE(j << TBL_SHIFT, 3 | global);
+  }
+  for (int i = 1; i < PHY_MEM / PT_SIZE; i++)
+  {
+    kpd.pde[i].val = MAKE_PDE(i << DIR_SHIFT, 3 | PTE_PS | global); // Assuming kernel space is accessible in supervisor mode
   }
-  kpt[0].pte[0].val = 0;
   set_cr3(&kpd);
-  set_cr0(get_cr0() | CR0_PG);
-  // Lab1-4: init free memory at [KER_MEM, PHY_MEM), a heap for kernel
-  free_page_list = (void *)KER_MEM;
-  page_t *p = free_page_list;
-  for (int i = 0; i < (PHY_MEM - KER_MEM) / PGSIZE - 1; i++) {
-    page_t *page = p + 1;
-    p->next = page;
-    p = p->next;
-  }
-  p->next = NULL;
+  // WP makes kernel writes to copy-on-write user pages fault as well
+  set_cr0(get_cr0() | CR0_PG | CR0_WP);
+  if (global)
+  {
+    set_cr4(get_cr4() | CR4_PGE);
+  }
+  // Lab1-4: init free memory at [KER_MEM, phy_top), a heap for kernel
+  // only RAM in the memory map from BIOS is used, RAM above PHY_MEM is
+  // not mapped so left alone; page descriptors take the first range
+  // large enough for all pages under phy_top
+  size_t start, top;
+  for (int i = 0; i < E820_MAX; i++) {
+    if (ram_range(i, &start, &top)) phy_top = MAX(phy_top, top);
+  }
+  size_t desc_size = PAGE_UP(phy_top / PGSIZE * sizeof(pgdesc_t));
+  for (int i = 0; i < E820_MAX && pgdesc == NULL; i++) {
+    if (ram_range(i, &start, &top) && top - start >= desc_size) {
+      pgdesc = (pgdesc_t *)start;
+    }
+  }
+  panic_on(pgdesc == NULL, "no memory for page descriptors");
+  memset(pgdesc, 0, desc_size);
+  for (int i = 0; i < E820_MAX; i++) {
+    if (!ram_range(i, &start, &top)) continue;
+    if (start == (size_t)pgdesc) start += desc_size;
+    buddy_add(start, top);
+  }
+  panic_on(total_pages == 0, "no memory for kernel heap");
   // TODO();
+  zero_page = kalloc();
+  memset(zero_page, 0, PGSIZE);
+}
+
+void *kalloc_pages(int order)
+{
+  // alloc 2^order physically contiguous pages, NULL if no such block
+  assert(order >= 0 && order <= MAX_ORDER);
+  int n = order;
+  while (n <= MAX_ORDER && free_area[n] == NULL) {
+    n++;
+  }
+  if (n > MAX_ORDER) {
+    return NULL;
+  }
+  page_t *page = free_area[n];
+  buddy_remove(page, n);
+  // split it, give back the upper halves
+  while (n > order) {
+    n--;
+    buddy_push((page_t *)((uint32_t)page + (PGSIZE << n)), n);
+  }
+  PA2DESC(page)->order = order;
+  PA2DESC(page)->ref = 1;
+  return page;
 }
 
 void *kalloc()
 {
   // Lab1-4: alloc a page from kernel heap, abort when heap empty
   // TODO();
-  if (free_page_list->next == NULL)
+  page_t *page = free_area[0];
+  if (page == NULL)
   {
-    // TODO: Decide what to do when there is no free memory
-    // assert(0); // or return NULL
-    return NULL; // For now, returning NULL when there is no free memory
+    // split a larger block, or use a zeroed page at last
+    page = kalloc_pages(0);
+    if (page == NULL && zpool_num > 0)
+    {
+      page = zpool[--zpool_num];
+    }
+    if (page == NULL && swap_reclaim(SWAP_BATCH) > 0)
+    {
+      // memory is full, page out cold pages of procs
+      page = kalloc_pages(0);
+    }
+    return page;
   }
-
-  // Allocate a page from the kernel heap
-  page_t *allocated_page = free_page_list;
-  void *temp = free_page_list->next;
-  free_page_list->next = NULL;
-  free_page_list = temp;
-
-  return allocated_page;
+  buddy_remove(page, 0);
+  PA2DESC(page)->order = 0;
+  PA2DESC(page)->ref = 1;
+  return page;
 }
 
 void kfree(void *ptr)
@@ -95,22 +263,108 @@ void kfree(void *ptr)
     return;
   }
 
-  // Free a page to the kernel heap
-  page_t *page = (page_t *)ptr;
-  page->next = free_page_list;
-  free_page_list = page;
+  // Drop a reference, free the block to the kernel heap when no one uses it
+  pgdesc_t *desc = PA2DESC(ptr);
+  assert(desc->ref > 0 && !desc->free);
+  if (--desc->ref > 0)
+  {
+    return;
+  }
+  buddy_free(ptr, desc->order);
+}
+
+void *kdup(void *ptr)
+{
+  // add a reference to a page allocated by kalloc
+  pgdesc_t *desc = PA2DESC(ptr);
+  assert(desc->ref > 0);
+  desc->ref++;
+  return ptr;
+}
+
+int kref(void *ptr)
+{
+  return PA2DESC(ptr)->ref;
+}
+
+uint32_t *ksum(void *ptr)
+{
+  // checksum slot of the page, kept for same page merging
+  return &PA2DESC(ptr)->sum;
+}
+
+size_t kavail(int order)
+{
+  // number of free blocks of order
+  return free_count[order];
+}
+
+void *kalloc_zeroed()
+{
+  // alloc a zero filled page, take a pre-zeroed one if any
+  if (zpool_num > 0) {
+    zpool_hit++;
+    return zpool[--zpool_num];
+  }
+  zpool_miss++;
+  void *page = kalloc();
+  if (page != NULL) {
+    memset(page, 0, PGSIZE);
+  }
+  return page;
+}
+
+int kzero_refill()
+{
+  // zero a page for the pool, called by the idle loop with interrupts on,
+  // so only allocator operations are done with them off
+  // return 0 if pool is full or no memory
+  cli();
+  void *page = zpool_num < ZPOOL_SIZE ? kalloc_pages(0) : NULL;
+  sti();
+  if (page == NULL) {
+    return 0;
+  }
+  memset(page, 0, PGSIZE);
+  cli();
+  if (zpool_num < ZPOOL_SIZE) {
+    zpool[zpool_num++] = page;
+  } else {
+    kfree(page);
+  }
+  sti();
+  return 1;
+}
+
+void kmeminfo(struct meminfo *mi)
+{
+  mi->total = total_pages;
+  mi->free = zpool_num;
+  for (int i = 0; i <= MAX_ORDER; i++) {
+    mi->free += free_count[i] << i;
+  }
+  mi->zero_hit = zpool_hit;
+  mi->zero_miss = zpool_miss;
+  swap_info(&mi->swap_total, &mi->swap_used);
+  mi->ksm_saved = ksm_saved();
+  mi->huge_alloc = huge_alloc;
 }
 
 PD *vm_alloc()
 {
   // Lab1-4: alloc a new pgdir, map memory under PHY_MEM identityly
+  // return NULL if no memory
   // TODO();
   PD *pd = (PD *)kalloc();
+  if (pd == NULL)
+  {
+    return NULL;
+  }
   for (int i = 0; i < NR_PDE; i++)
   {
-    if (i < 32)
+    if (i < PHY_MEM / PT_SIZE)
     {
-      pd->pde[i].val = MAKE_PDE((uint32_t)(&kpt[i]), 3);
+      pd->pde[i].val = kpd.pde[i].val;
     }
     else
     {
@@ -132,15 +386,20 @@ void vm_teardown(PD *pgdir)
 
   for (int i = 0; i < NR_PDE; i++)
   {
-    if (i < 32)
+    if (i < PHY_MEM / PT_SIZE)
     {
-      // Skip the first 32 PDEs (corresponding to kpt)
+      // Skip the first 32 PDEs (the kernel identity map)
       continue;
     }
 
     PDE *pde = &(pgdir->pde[i]);
 
-    if (pde->present)
+    if (pde->val & PTE_PS)
+    {
+      // A huge page is one block of the buddy allocator
+      kfree(PDE2PT(*pde));
+    }
+    else if (pde->present)
     {
       // If PDE is present, free the corresponding page table and its mapped pages
       PT *pt = PDE2PT(*pde);
@@ -155,6 +414,11 @@ void vm_teardown(PD *pgdir)
           void *page = PTE2PG(*pte);
           kfree(page);
         }
+        else if (pte->val & PTE_SWAP)
+        {
+          // If it is swapped out, free its slot
+          swap_drop(*pte);
+        }
       }
 
       // Free the page table
@@ -171,6 +435,27 @@ PD *vm_curr()
   return (PD *)PAGE_DOWN(get_cr3());
 }
 
+static PT *vm_split(PD *pgdir, PDE *pde)
+{
+  // turn a huge page into a page table of its 4 KiB pages, which become
+  // separate pages of the allocator, return NULL if no memory
+  PT *pt = (PT *)kalloc();
+  if (pt == NULL) {
+    return NULL;
+  }
+  char *page = (char *)PDE2PT(*pde);
+  for (int i = 0; i < NR_PTE; i++, page += PGSIZE) {
+    PA2DESC(page)->order = 0;
+    PA2DESC(page)->ref = 1;
+    pt->pte[i].val = MAKE_PTE(page, pde->val & 7);
+  }
+  pde->val = MAKE_PDE(pt, 7);
+  if (pgdir == vm_curr()) {
+    flush_tlb(); // drop the 4 MiB entry
+  }
+  return pt;
+}
+
 PTE *vm_walkpte(PD *pgdir, size_t va, int prot)
 {
   // Lab1-4: return the pointer of PTE which match va
@@ -186,6 +471,11 @@ PTE *vm_walkpte(PD *pgdir, size_t va, int prot)
 
   int pd_index = ADDR2DIR(va);
   PDE *pde = &(pgdir->pde[pd_index]);
+  if (pde->val & PTE_PS) {
+    // 4 MiB pages have no PT, callers needing PTEs of a user huge page
+    // split it by themselves
+    return NULL;
+  }
 
   if (!pde->present) {
     // PDE not present
@@ -194,16 +484,13 @@ PTE *vm_walkpte(PD *pgdir, size_t va, int prot)
       return NULL;
     }
 
-    // Allocate a new page table
-    PT *new_pt = (PT *)kalloc();
+    // Allocate a new cleared page table
+    PT *new_pt = (PT *)kalloc_zeroed();
     if (new_pt == NULL) {
       // Allocation failed
       return NULL;
     }
 
-    // Clear the page table
-    memset(new_pt, 0, PGSIZE);
-
     // Set up the new PDE
     pde->val = MAKE_PDE((uint32_t)new_pt, prot | PTE_P);
 
@@ -222,6 +509,11 @@ void *vm_walk(PD *pgdir, size_t va, int prot)
   // Lab1-4: translate va to pa
   // if prot&1 and prot voilation ((pte->val & prot & 7) != prot), call vm_pgfault
   // if va is not mapped and !(prot&1), return NULL
+  PDE *pde = &pgdir->pde[ADDR2DIR(va)];
+  if (va >= PHY_MEM && (pde->val & PTE_PS)) {
+    // in a user huge page, no need to split it
+    return (void*)((uint32_t)PDE2PT(*pde) | (va & (PT_SIZE - 1)));
+  }
   PTE* pte = vm_walkpte(pgdir, va, prot);
   void *page = PTE2PG(*pte); // 根据PTE找物理页的地址
   void *pa = (void*)((uint32_t)page | ADDR2OFF(va)); // 补上页内偏移量
@@ -243,40 +535,436 @@ void vm_map(PD *pgdir, size_t va, size_t len, int prot)
   for (size_t current_va = start; current_va < end; current_va += PGSIZE) {
     PTE *pte = vm_walkpte(pgdir, current_va, prot);
 
-    if (pte != NULL) {
-      PT* pt=kalloc();
+    if (pte == NULL) {
+      // page table allocation failed, we can ignore it.
+      continue;
+    }
+    if (pte->val & PTE_SWAP) {
+      // mapped but swapped out, bring it back first
+      assert(swap_in(pte));
+    }
+    if (pte->present) {
+      // already mapped, add prot but keep a copy-on-write page read only
+      pte->val |= (pte->val & PTE_COW) ? (prot & ~PTE_W) : prot;
+      if (pgdir == vm_curr()) {
+        invlpg((void*)current_va);
+      }
+    } else {
+      void *page = kalloc_zeroed();
+      assert(page);
       // Set up the PTE
-      pte->val = MAKE_PTE(pt, prot | PTE_P);
+      pte->val = MAKE_PTE(page, prot | PTE_P);
     }
-    // If pte is NULL, it means the page table allocation failed or prot is 0, and we can ignore it.
   }
 }
 
-void vm_unmap(PD *pgdir, size_t va, size_t len)
+int vm_unmap(PD *pgdir, size_t va, size_t len)
 {
   // Lab1-4: unmap and free [va, va+len) at pgdir
   // you can just do nothing :)
-  // assert(ADDR2OFF(va) == 0);
-  // assert(ADDR2OFF(len) == 0);
+  // return -1 if a huge page partly in the range can't be split, and then
+  // nothing is unmapped
+  assert(ADDR2OFF(va) == 0);
+  assert(ADDR2OFF(len) == 0);
+  assert(va >= PHY_MEM);
   // TODO();
+  // only the first and the last PDE can be partly in the range, split
+  // their huge pages before anything is unmapped
+  size_t ends[] = {va, va + len - PGSIZE};
+  for (int i = 0; i < 2 && len > 0; i++) {
+    size_t dir = ends[i] & ~(PT_SIZE - 1);
+    PDE *pde = &pgdir->pde[ADDR2DIR(dir)];
+    if ((pde->val & PTE_PS) && (dir < va || dir + PT_SIZE > va + len) &&
+        vm_split(pgdir, pde) == NULL) {
+      return -1;
+    }
+  }
+  // drop stale TLB entries one by one, or all at once if too many
+  int curr = pgdir == vm_curr(), flush = curr && len > INVLPG_MAX * PGSIZE;
+  for (size_t cur = va; cur < va + len; cur += PGSIZE) {
+    PDE *pde = &pgdir->pde[ADDR2DIR(cur)];
+    if (!pde->present) {
+      // skip the whole empty page table
+      cur = PAGE_DOWN(cur | (PT_SIZE - 1));
+      continue;
+    }
+    int whole = ADDR2TBL(cur) == 0 && cur + PT_SIZE <= va + len;
+    if (pde->val & PTE_PS) {
+      assert(whole); // split above if not
+      kfree(PDE2PT(*pde));
+      pde->val = 0;
+      flush = curr;
+      cur += PT_SIZE - PGSIZE;
+      continue;
+    }
+    PT *pt = PDE2PT(*pde);
+    if (whole) {
+      // the whole page table is unmapped, free it with its pages
+      for (int i = 0; i < NR_PTE; i++) {
+        if (pt->pte[i].present) {
+          kfree(PTE2PG(pt->pte[i]));
+        } else if (pt->pte[i].val & PTE_SWAP) {
+          swap_drop(pt->pte[i]);
+        }
+      }
+      kfree(pt);
+      pde->val = 0;
+      flush = curr;
+      cur += PT_SIZE - PGSIZE;
+      continue;
+    }
+    PTE *pte = &pt->pte[ADDR2TBL(cur)];
+    if (pte->present) {
+      kfree(PTE2PG(*pte));
+      if (curr && !flush) {
+        invlpg((void*)cur);
+      }
+    } else if (pte->val & PTE_SWAP) {
+      swap_drop(*pte);
+    }
+    pte->val = 0;
+  }
+  if (flush) {
+    flush_tlb();
+  }
+  return 0;
 }
 
-void vm_copycurr(PD *pgdir)
+int vm_copycurr(PD *pgdir)
 {
   // Lab2-2: copy memory mapped in curr pd to pgdir
-  // TODO();
-  for (size_t i = PHY_MEM; i < USR_MEM; i += PGSIZE) {
-    PTE *pte = vm_walkpte(proc_curr()->pgdir, i, 0);
-    if (pte != NULL && pte->present) {
-      vm_map(pgdir, i, PGSIZE,7);
-      void* pa = vm_walk(pgdir, i, 0);
-      memcpy(pa, (void*)(i), PGSIZE);
+  return vm_copy(pgdir, proc_curr()->pgdir);
+}
+
+int vm_copy(PD *pgdir, PD *src)
+{
+  // copy user memory mapped in src to pgdir, return -1 if no memory,
+  // and then pgdir has no user memory left
+  // share every page with pgdir instead of copying, writable pages of both
+  // sides become read only with PTE_COW, and get copied at the first write
+  int ret = 0;
+  for (int i = ADDR2DIR(PHY_MEM); i < ADDR2DIR(USR_MEM); i++) {
+    if (!src->pde[i].present) {
+      // skip the whole empty page table
+      continue;
+    }
+    if ((src->pde[i].val & PTE_PS) && vm_split(src, &src->pde[i]) == NULL) {
+      // share it page by page, so a write copies 4 KiB instead of 4 MiB
+      ret = -1;
+      goto out;
+    }
+    PT *pt = PDE2PT(src->pde[i]);
+    for (int j = 0; j < NR_PTE; j++) {
+      PTE *pte = &pt->pte[j];
+      if (!pte->present && !(pte->val & PTE_SWAP)) {
+        continue;
+      }
+      // alloc may page out pte, so look at pte after it
+      PTE *child = vm_walkpte(pgdir, (i << DIR_SHIFT) | (j << TBL_SHIFT), 7);
+      if (child == NULL) {
+        ret = -1;
+        goto out;
+      }
+      if (!pte->present) {
+        // swapped out, share the slot
+        swap_dup(*pte);
+      } else {
+        if ((pte->val & PTE_W) && !(pte->val & PTE_SHARED)) {
+          pte->val = (pte->val & ~PTE_W) | PTE_COW;
+        }
+        kdup(PTE2PG(*pte));
+      }
+      child->val = pte->val;
+    }
+  }
+out:
+  if (ret != 0) {
+    // drop what is shared so far, pages of src stay copy-on-write
+    vm_unmap(pgdir, PHY_MEM, USR_MEM - PHY_MEM);
+  }
+  if (src == vm_curr()) {
+    flush_tlb(); // curr has lost write permission of its pages
+  }
+  return ret;
+}
+
+size_t vm_resident(PD *pgdir)
+{
+  // number of user pages mapped in pgdir
+  size_t n = 0;
+  for (int i = ADDR2DIR(PHY_MEM); i < ADDR2DIR(USR_MEM); i++) {
+    if (!pgdir->pde[i].present) {
+      continue;
+    }
+    if (pgdir->pde[i].val & PTE_PS) {
+      n += NR_PTE;
+      continue;
+    }
+    PT *pt = PDE2PT(pgdir->pde[i]);
+    for (int j = 0; j < NR_PTE; j++) {
+      n += pt->pte[j].present;
+    }
+  }
+  return n;
+}
+
+void vm_msync(PD *pgdir, vma_t *vma, size_t start, size_t end)
+{
+  // write pages of a shared file vma dirtied in [start, end) back to the file,
+  // the part of a page beyond the end of file is not written
+  uint32_t size = isize(vma->inode);
+  for (size_t va = start; va < end; va += PGSIZE) {
+    PDE *pde = &pgdir->pde[ADDR2DIR(va)];
+    if (!pde->present) {
+      // skip the whole empty page table
+      va = PAGE_DOWN(va | (PT_SIZE - 1));
+      continue;
+    }
+    PTE *pte = &PDE2PT(*pde)->pte[ADDR2TBL(va)];
+    if (!pte->present || !(pte->val & PTE_D)) {
+      continue;
+    }
+    uint32_t off = vma->off + (va - vma->start);
+    if (off < size) {
+      iwrite(vma->inode, off, PTE2PG(*pte), MIN(PGSIZE, size - off));
+    }
+    pte->val &= ~PTE_D;
+    if (pgdir == vm_curr()) {
+      invlpg((void*)va); // let CPU set dirty bit again
+    }
+  }
+}
+
+static int vm_cow(size_t va)
+{
+  // resolve a write fault on a copy-on-write page, return 0 if not such case
+  PTE *pte = vm_walkpte(vm_curr(), va, 0);
+  if (pte == NULL || !pte->present || !(pte->val & PTE_COW)) {
+    return 0;
+  }
+  void *page = PTE2PG(*pte);
+  if (kref(page) > 1) {
+    // still shared, make a private copy and drop the shared one
+    void *copy = kalloc();
+    if (copy == NULL) {
+      return 0;
+    }
+    memcpy(copy, page, PGSIZE);
+    kfree(page);
+    page = copy;
+  }
+  pte->val = MAKE_PTE(page, (pte->val & PTE_U) | PTE_W);
+  invlpg((void*)va);
+  return 1;
+}
+
+static int vm_huge(vma_t *vma, size_t va)
+{
+  // back the aligned 4 MiB of va by a huge page if the heap covers all of it
+  // and its page table is not used yet, return 0 to use 4 KiB pages instead
+  size_t start = va & ~(PT_SIZE - 1);
+  PDE *pde = &vm_curr()->pde[ADDR2DIR(va)];
+  if (vma->type != VMA_HEAP || start < vma->start || start + PT_SIZE > vma->end || pde->present) {
+    return 0;
+  }
+  void *page = kalloc_pages(MAX_ORDER);
+  if (page == NULL) {
+    return 0;
+  }
+  huge_alloc++;
+  memset(page, 0, PT_SIZE);
+  pde->val = MAKE_PDE(page, vma->prot | PTE_PS);
+  return 1;
+}
+
+static int vm_demand(size_t va, int write)
+{
+  // map the page of va on its first touch, return 0 if va is in no vma
+  PTE *old = vm_walkpte(vm_curr(), va, 0);
+  if (old != NULL && (old->val & PTE_SWAP)) {
+    return swap_in(old);
+  }
+  vma_t *vma = vma_find(proc_curr()->vmas, va);
+  if (vma == NULL || (write && !(vma->prot & PTE_W))) {
+    return 0;
+  }
+  if (vm_huge(vma, va)) {
+    return 1;
+  }
+  PTE *pte = vm_walkpte(vm_curr(), va, 7);
+  if (pte == NULL) {
+    return 0;
+  }
+  void *page;
+  if (vma->type == VMA_SHARED) {
+    // writes go to the cached page, so all mappings and read see them
+    page = pcache_get_shared(vma->inode, (vma->off + PAGE_DOWN(va) - vma->start) / PGSIZE);
+    if (page == NULL) {
+      return 0;
+    }
+    pte->val = MAKE_PTE(page, vma->prot | PTE_SHARED);
+    return 1;
+  } else if (vma->type == VMA_SHM) {
+    page = shm_page(vma->shm, (vma->off + PAGE_DOWN(va) - vma->start) / PGSIZE);
+    if (page == NULL) {
+      return 0;
+    }
+    pte->val = MAKE_PTE(page, vma->prot | PTE_SHARED);
+    return 1;
+  } else if (vma->type == VMA_FILE) {
+    page = pcache_get(vma->inode, (vma->off + PAGE_DOWN(va) - vma->start) / PGSIZE);
+  } else if (write) {
+    page = kalloc_zeroed();
+    if (page == NULL) {
+      return 0;
     }
+    pte->val = MAKE_PTE(page, vma->prot);
+    return 1;
+  } else {
+    // only read yet, share the zero page until the first write
+    page = kdup(zero_page);
   }
+  if (page == NULL) {
+    return 0;
+  }
+  // the page is shared, writable vma gets a private copy at the first write
+  if (vma->prot & PTE_W) {
+    pte->val = MAKE_PTE(page, (vma->prot & ~PTE_W) | PTE_COW);
+  } else {
+    pte->val = MAKE_PTE(page, vma->prot);
+  }
+  return write ? vm_cow(va) : 1;
 }
 
 void vm_pgfault(size_t va, int errcode)
 {
+  // it may come from kernel too, e.g. syscall writes to a user buffer
+  if (va >= PHY_MEM && va < USR_MEM) {
+    if ((errcode & PF_P) && (errcode & PF_W) && vm_cow(va)) return;
+    if (!(errcode & PF_P) && vm_demand(va, errcode & PF_W)) return;
+  }
   printf("pagefault @ 0x%p, errcode = %d\n", va, errcode);
   panic("pgfault");
 }
+
+vma_t *vma_add(vma_t *vmas, size_t start, size_t end, int prot, int type)
+{
+  // add [start, end) to vmas, return NULL if vmas is full
+  assert(ADDR2OFF(start) == 0 && ADDR2OFF(end) == 0 && start <= end);
+  for (int i = 0; i < MAX_VMA; i++) {
+    if (vmas[i].type == VMA_NONE) {
+      memset(&vmas[i], 0, sizeof(vma_t));
+      vmas[i].start = start;
+      vmas[i].end = end;
+      vmas[i].prot = prot;
+      vmas[i].type = type;
+      return &vmas[i];
+    }
+  }
+  return NULL;
+}
+
+vma_t *vma_find(vma_t *vmas, size_t va)
+{
+  for (int i = 0; i < MAX_VMA; i++) {
+    if (vmas[i].type != VMA_NONE && vmas[i].start <= va && va < vmas[i].end) {
+      return &vmas[i];
+    }
+  }
+  return NULL;
+}
+
+vma_t *vma_type(vma_t *vmas, int type)
+{
+  // find the first vma of type, useful for the unique heap and stack
+  for (int i = 0; i < MAX_VMA; i++) {
+    if (vmas[i].type == type) {
+      return &vmas[i];
+    }
+  }
+  return NULL;
+}
+
+void vma_dup(vma_t *dst, vma_t *src)
+{
+  // copy vmas of src to dst, both of them use the files
+  memcpy(dst, src, MAX_VMA * sizeof(vma_t));
+  for (int i = 0; i < MAX_VMA; i++) {
+    if (dst[i].inode != NULL) {
+      idup(dst[i].inode);
+    }
+    if (dst[i].shm != NULL) {
+      shm_dup(dst[i].shm);
+    }
+  }
+}
+
+void vma_clear(vma_t *vmas)
+{
+  // drop all vmas, mapped pages are left to the pgdir
+  for (int i = 0; i < MAX_VMA; i++) {
+    if (vmas[i].inode != NULL) {
+      iclose(vmas[i].inode);
+    }
+    if (vmas[i].shm != NULL) {
+      shm_close(vmas[i].shm);
+    }
+  }
+  memset(vmas, 0, MAX_VMA * sizeof(vma_t));
+}
+
+void vma_sync(PD *pgdir, vma_t *vmas)
+{
+  // write back all shared file vmas, before they are dropped
+  for (int i = 0; i < MAX_VMA; i++) {
+    if (vmas[i].type == VMA_SHARED) {
+      vm_msync(pgdir, &vmas[i], vmas[i].start, vmas[i].end);
+    }
+  }
+}
+
+size_t vma_gap(vma_t *vmas, size_t len)
+{
+  // find the lowest free range of len in the mmap area, return 0 if none
+  size_t start = MMAP_BASE;
+  for (int i = 0; i < MAX_VMA; i++) {
+    vma_t *vma = &vmas[i];
+    if (vma->type != VMA_NONE && vma->start < start + len && start < vma->end) {
+      // overlapped, try right after it and check all vmas again
+      start = vma->end;
+      i = -1;
+    }
+  }
+  return start + len <= USR_MEM - STACK_LIMIT ? start : 0;
+}
+
+int vma_cut(vma_t *vmas, vma_t *vma, size_t start, size_t end)
+{
+  // remove [start, end) inside vma from it, which may split it into two,
+  // return -1 if vmas is full for the split
+  assert(vma->start <= start && start < end && end <= vma->end);
+  if (start == vma->start && end == vma->end) {
+    if (vma->inode != NULL) {
+      iclose(vma->inode);
+    }
+    if (vma->shm != NULL) {
+      shm_close(vma->shm);
+    }
+    memset(vma, 0, sizeof(vma_t));
+  } else if (start == vma->start) {
+    vma->off += end - vma->start;
+    vma->start = end;
+  } else if (end == vma->end) {
+    vma->end = start;
+  } else {
+    vma_t *tail = vma_add(vmas, end, vma->end, vma->prot, vma->type);
+    if (tail == NULL) {
+      return -1;
+    }
+    tail->inode = vma->inode ? idup(vma->inode) : NULL;
+    tail->shm = vma->shm ? shm_dup(vma->shm) : NULL;
+    tail->off = vma->off + (end - vma->start);
+    vma->end = start;
+  }
+  return 0;
+}
@@ -88,12 +88,20 @@ char *strtok(char *__restrict s, const char *__restrict delim);
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
 #define O_DIR     0x800
+#define O_DIRECT  0x1000 // aligned read/write bypass the cache
 
 // seek whence
 #define SEEK_SET 0
 #define SEEK_CUR 1
 #define SEEK_END 2
 
+// mmap prot and flags
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+#define MAP_SHARED  0x1 // writes go to the file, seen by all its mappings
+#define MAP_PRIVATE 0x2 // writes go to a private copy
+#define MAP_FAILED  ((void*)-1)
+
 // file stat
 struct stat {
   uint32_t type;
@@ -101,4 +109,53 @@ struct stat {
   uint32_t node;
 };
 
+// readv/writev buffer
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+
+#define IOV_MAX 64
+
+// spawn file action, applied in order to the fd table of child
+struct spawn_action {
+  int type;         // SA_*
+  int fd;           // fd to close or dup
+  const char *path; // file to open
+  int mode, whence; // open mode, and seek whence after open
+};
+
+#define SA_END   0 // end of the action list
+#define SA_CLOSE 1 // close(fd)
+#define SA_DUP   2 // dup(fd) to the lowest free fd
+#define SA_OPEN  3 // open(path, mode) to the lowest free fd, then lseek(0, whence)
+
+// getdents flag, also fill the stat of each entry
+#define GD_STAT 0x1
+
+// getdents entry, name is '\0' terminated
+struct dirent_stat {
+  struct stat st;
+  char name[28]; // enough for MAX_NAME of both fs
+};
+
+// memory usage, counted in pages
+struct meminfo {
+  uint32_t total; // pages of kernel heap, all memory user and kernel alloc from
+  uint32_t free;  // free pages of kernel heap
+  uint32_t rss;   // user pages mapped by the proc
+  uint32_t zero_hit, zero_miss; // allocs of zero filled page found a pre-zeroed one or not
+  uint32_t swap_total, swap_used; // pages of swap area
+  uint32_t ksm_saved; // pages saved by same page merging
+  uint32_t huge_alloc; // user 4 MiB pages ever mapped
+  uint32_t cr3_load, cr3_skip; // context switches that load CR3 (flush TLB) or not
+};
+
+// scheduling state of a proc, all times are in timer ticks
+struct schedinfo {
+  int prio, nice; // MLFQ level and top level
+  uint32_t period, runtime, deadline; // real-time params, period is 0 if not real-time
+  uint32_t jobs, miss; // real-time jobs finished, and those missed their deadline
+};
+
 #endif
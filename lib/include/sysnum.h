@@ -38,6 +38,19 @@
 #define SYS_link      31
 #define SYS_symlink   32
 
-#define NR_SYS        33
+// extended syscall
+#define SYS_getdents  33
+#define SYS_sendfile  34
+#define SYS_readv     35
+#define SYS_writev    36
+#define SYS_spawn     37
+#define SYS_meminfo   38
+#define SYS_shmat     39
+#define SYS_nice      40
+#define SYS_sched_rt  41
+#define SYS_schedinfo 42
+#define SYS_sem_p_timeout 43
+
+#define NR_SYS        44
 
 #endif
@@ -30,8 +30,8 @@ int unlink(const char *path);
 #define V sem_v
 
 // optional syscall
-void *mmap();
-void munmap(void *addr);
+void *mmap(int fd, uint32_t off, size_t len, int prot, int flags);
+int munmap(void *addr, size_t len);
 int clone(void (*entry)(void*), void *stack, void *arg);
 int kill(int pid);
 int cv_open();
@@ -43,6 +43,19 @@ int pipe(int fd[2]);
 int link(const char *oldpath, const char *newpath);
 int symlink(const char *oldpath, const char *newpath);
 
+// extended syscall
+int getdents(int fd, struct dirent_stat *buf, int count, int flags);
+int sendfile(int out_fd, int in_fd, uint32_t count);
+int readv(int fd, const struct iovec *iov, int iovcnt);
+int writev(int fd, const struct iovec *iov, int iovcnt);
+int spawn(const char *path, char *const argv[], const struct spawn_action *acts);
+int meminfo(int pid, struct meminfo *mi);
+void *shmat(const char *name, size_t len);
+int nice(int inc);
+int sched_rt(uint32_t period, uint32_t runtime, uint32_t deadline);
+int schedinfo(int pid, struct schedinfo *si);
+int sem_p_timeout(int sem_id, int ticks);
+
 // stdio
 void putstr(const char *str);
 int printf(const char *format, ...);
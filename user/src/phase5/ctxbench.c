@@ -0,0 +1,88 @@
+#include "ulib.h"
+
+// ctxbench [n]: measure cycles of a syscall and of a context switch,
+// and how many switches had to load CR3 (thus flushed TLB)
+
+#define N 1000
+
+static inline uint64_t
+rdtsc(void)
+{
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static uint32_t
+per_op(uint64_t cycles, uint32_t n)
+{
+  // cycles / n by divl, no libgcc for a 64-bit divide
+  uint32_t q, r;
+
+  if((uint32_t)(cycles >> 32) >= n)
+    return 0xffffffff; // quotient does not fit
+  asm("divl %4" : "=a"(q), "=d"(r)
+      : "a"((uint32_t)cycles), "d"((uint32_t)(cycles >> 32)), "rm"(n));
+  return q;
+}
+
+static void
+report(const char *name, uint64_t cycles, int n, struct meminfo *before)
+{
+  struct meminfo mi;
+
+  meminfo(0, &mi);
+  printf("%s: %u cycles/op, cr3 load %d, skip %d\n", name, per_op(cycles, n),
+    mi.cr3_load - before->cr3_load, mi.cr3_skip - before->cr3_skip);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct meminfo mi;
+  uint64_t t;
+  int i, n, pid, ping, pong;
+
+  n = argc > 1 ? atoi(argv[1]) : N;
+  if(n <= 0)
+    n = N;
+
+  meminfo(0, &mi);
+  t = rdtsc();
+  for(i = 0; i < n; i++)
+    getpid();
+  report("getpid", rdtsc() - t, n, &mi);
+
+  // no one else runs, the scheduler picks us again
+  meminfo(0, &mi);
+  t = rdtsc();
+  for(i = 0; i < n; i++)
+    yield();
+  report("yield alone", rdtsc() - t, n, &mi);
+
+  // ping-pong with a child through two sems, every P blocks and switches
+  // to the other pgdir whatever levels the scheduler has put them at
+  ping = sem_open(0);
+  pong = sem_open(0);
+  pid = fork();
+  if(pid < 0){
+    printf("ctxbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < n; i++){
+      P(ping);
+      V(pong);
+    }
+    exit(0);
+  }
+  meminfo(0, &mi);
+  t = rdtsc();
+  for(i = 0; i < n; i++){
+    V(ping);
+    P(pong);
+  }
+  report("sem pair", rdtsc() - t, 2 * n, &mi);
+  wait(0);
+  exit(0);
+}
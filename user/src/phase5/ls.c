@@ -19,11 +19,14 @@ fmtname(char *path)
   return buf;
 }
 
+#define NDENTS 16
+
 void
 ls(char *path)
 {
-  int fd;
+  int fd, n, i;
   struct stat st;
+  struct dirent_stat des[NDENTS];
 
   if((fd = open(path, 0)) < 0){
     fprintf(2, "ls: cannot open %s\n", path);
@@ -43,7 +46,14 @@ ls(char *path)
     break;
 
   case TYPE_DIR:
-    panic("not support dir");
+    // entries come with their stat, no open/fstat/close per entry
+    while((n = getdents(fd, des, NDENTS, GD_STAT)) > 0){
+      for(i = 0; i < n; i++)
+        printf("%s %d %d %d\n", fmtname(des[i].name),
+               des[i].st.type, des[i].st.size, des[i].st.node);
+    }
+    if(n < 0)
+      printf("ls: cannot read %s\n", path);
     break;
   }
   close(fd);
@@ -0,0 +1,34 @@
+#include "ulib.h"
+
+// rtloop period runtime [jobs]: run a periodic real-time loop, each job
+// spins a little and then yields, which ends the job until its next release,
+// report misses at end
+
+volatile int sink;
+
+int
+main(int argc, char *argv[])
+{
+  struct schedinfo si;
+  int period, runtime, jobs, i, j;
+
+  if(argc < 3){
+    fprintf(2, "usage: rtloop period runtime [jobs]\n");
+    exit(1);
+  }
+  period = atoi(argv[1]);
+  runtime = atoi(argv[2]);
+  jobs = argc > 3 ? atoi(argv[3]) : 100;
+  if(sched_rt(period, runtime, 0) < 0){
+    printf("rtloop: not admitted\n");
+    exit(1);
+  }
+  for(i = 0; i < jobs; i++){
+    for(j = 0; j < 10000; j++)
+      sink += j;
+    yield(); // the job is done, wait for the next one
+  }
+  schedinfo(0, &si);
+  printf("rtloop: %d jobs, %d missed\n", si.jobs, si.miss);
+  exit(0);
+}
@@ -0,0 +1,33 @@
+#include "ulib.h"
+
+// semwait [ticks]: a child posts a sem after sleeping 2*ticks, the parent
+// waits for it with a timeout of ticks, which should expire, and then
+// with 3*ticks, which should not
+
+int
+main(int argc, char *argv[])
+{
+  int ticks, sem, r1, r2;
+
+  ticks = argc > 1 ? atoi(argv[1]) : 50;
+  if(ticks <= 0){
+    fprintf(2, "usage: semwait [ticks]\n");
+    exit(1);
+  }
+  if((sem = sem_open(0)) < 0){
+    fprintf(2, "semwait: sem_open failed\n");
+    exit(1);
+  }
+  if(fork() == 0){
+    sleep(2 * ticks);
+    V(sem);
+    exit(0);
+  }
+  r1 = sem_p_timeout(sem, ticks);
+  r2 = sem_p_timeout(sem, 3 * ticks);
+  wait(0);
+  printf("semwait: first %s, second %s\n",
+         r1 < 0 ? "timed out" : "acquired", r2 < 0 ? "timed out" : "acquired");
+  sem_close(sem);
+  exit(r1 < 0 && r2 == 0 ? 0 : 1);
+}
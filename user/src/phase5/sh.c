@@ -47,6 +47,7 @@ struct backcmd {
 };
 
 int fork1(void);  // Fork but panics on failure.
+int spawncmd(char*);  // Spawn a simple command without fork.
 void panic(char*);
 struct cmd *parsecmd(char*);
 
@@ -149,6 +150,8 @@ main(void)
   static char buf[100];
   // Read and run input commands.
   while(getcmd(buf, sizeof(buf)) >= 0){
+    if(spawncmd(buf) == 0)
+      continue;
     if(fork1() == 0)
       runcmd(parsecmd(buf));
     wait(0);
@@ -479,3 +482,74 @@ nulterminate(struct cmd *cmd)
   return cmd;
 }
 
+//PAGEBREAK!
+// Spawning
+
+// Whether s is a simple command, i.e. only words and redirections.
+// Such one can be parsed by sh itself, since parsecmd cannot panic on it.
+int
+simplecmd(char *s)
+{
+  char *es;
+  int tok, argc, nredir;
+
+  es = s + strlen(s);
+  argc = nredir = 0;
+  while((tok = gettoken(&s, es, 0, 0)) != 0){
+    if(tok == 'a'){
+      if(++argc >= MAXARGS)
+        return 0;
+      continue;
+    }
+    if(tok != '<' && tok != '>' && tok != '+')
+      return 0;
+    if(++nredir > MAXARGS || gettoken(&s, es, 0, 0) != 'a')
+      return 0;
+  }
+  return argc > 0;
+}
+
+// Run a simple command by spawn, the child is built from the elf
+// directly and redirections are done by kernel, so sh is never copied.
+// Return -1 if buf is not a simple command.
+int
+spawncmd(char *buf)
+{
+  struct spawn_action acts[2*MAXARGS+1];
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  struct cmd *cmd;
+  int n, pid;
+
+  if(!simplecmd(buf))
+    return -1;
+  cmd = parsecmd(buf);
+  // redirections are applied from outside in, just like runcmd
+  n = 0;
+  while(cmd->type == REDIR){
+    rcmd = (struct redircmd*)cmd;
+    acts[n].type = SA_CLOSE;
+    acts[n].fd = rcmd->fd;
+    n++;
+    acts[n].type = SA_OPEN;
+    acts[n].path = rcmd->file;
+    acts[n].mode = rcmd->mode;
+    acts[n].whence = rcmd->whence;
+    n++;
+    cmd = rcmd->cmd;
+    free(rcmd);
+  }
+  acts[n].type = SA_END;
+  ecmd = (struct execcmd*)cmd;
+  pid = spawn(ecmd->argv[0], ecmd->argv, acts);
+  if(pid == -1)
+    fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+  else if(pid < -1 && acts[-2-pid].type == SA_OPEN)
+    fprintf(2, "open %s failed\n", acts[-2-pid].path);
+  else if(pid < -1)
+    fprintf(2, "redirect failed\n");
+  else
+    wait(0);
+  free(ecmd);
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include "ulib.h"
+
+// tlbbench: random reads over a heap of 4 KiB pages and one of 4 MiB pages,
+// the kernel backs a heap region by a huge page if the heap covers all of
+// the aligned 4 MiB at its first touch
+
+#define SIZE   (8 << 20)
+#define HUGE   (4 << 20)
+#define PGSIZE 4096
+#define ROUNDS 200000
+
+volatile int sink; // keeps the reads from being optimized out
+
+static inline uint64_t
+rdtsc(void)
+{
+  uint32_t lo, hi;
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+static uint32_t
+per_op(uint64_t cycles, uint32_t n)
+{
+  // cycles / n by divl, no libgcc for a 64-bit divide
+  uint32_t q, r;
+
+  if((uint32_t)(cycles >> 32) >= n)
+    return 0xffffffff; // quotient does not fit
+  asm("divl %4" : "=a"(q), "=d"(r)
+      : "a"((uint32_t)cycles), "d"((uint32_t)(cycles >> 32)), "rm"(n));
+  return q;
+}
+
+static uint64_t
+walk(int *mem)
+{
+  uint64_t t;
+  uint32_t seed = 12345;
+  int i, sum = 0;
+
+  t = rdtsc();
+  for(i = 0; i < ROUNDS; i++){
+    seed = seed * 1103515245 + 12345;
+    sum += mem[(seed >> 8) % (SIZE / sizeof(int))];
+  }
+  t = rdtsc() - t;
+  sink = sum;
+  return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct meminfo mi;
+  char *small, *huge;
+  uint32_t top;
+  int i;
+
+  // grow the heap a page at a time, so every touch sees a partial 4 MiB
+  small = sbrk(0);
+  for(i = 0; i < SIZE / PGSIZE; i++){
+    if(sbrk(PGSIZE) == (void*)-1){
+      printf("tlbbench: no memory\n");
+      exit(1);
+    }
+    small[i * PGSIZE] = 1;
+  }
+
+  // then grow it to a 4 MiB boundary and by the whole size at once
+  top = (uint32_t)sbrk(0);
+  sbrk(((top + HUGE - 1) & ~(HUGE - 1)) - top);
+  huge = sbrk(SIZE);
+  if(huge == (void*)-1){
+    printf("tlbbench: no memory\n");
+    exit(1);
+  }
+  meminfo(0, &mi);
+  i = mi.huge_alloc;
+  for(top = 0; top < SIZE; top += PGSIZE)
+    huge[top] = 1;
+  meminfo(0, &mi);
+  printf("huge pages mapped: %d\n", mi.huge_alloc - i);
+
+  printf("4 KiB pages: %u cycles/read\n", per_op(walk((int*)small), ROUNDS));
+  printf("4 MiB pages: %u cycles/read\n", per_op(walk((int*)huge), ROUNDS));
+  exit(0);
+}
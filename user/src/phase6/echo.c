@@ -3,15 +3,24 @@
 int
 main(int argc, char *argv[])
 {
-  int i;
+  struct iovec iov[IOV_MAX];
+  int i, n;
 
+  // gather args and separators, write them by one writev
+  n = 0;
   for(i = 1; i < argc; i++){
-    write(1, argv[i], strlen(argv[i]));
-    if(i + 1 < argc){
-      write(1, " ", 1);
-    } else {
-      write(1, "\n", 1);
+    iov[n].iov_base = argv[i];
+    iov[n].iov_len = strlen(argv[i]);
+    n++;
+    iov[n].iov_base = (i + 1 < argc) ? " " : "\n";
+    iov[n].iov_len = 1;
+    n++;
+    if(n == IOV_MAX){
+      writev(1, iov, n);
+      n = 0;
     }
   }
+  if(n > 0)
+    writev(1, iov, n);
   exit(0);
 }
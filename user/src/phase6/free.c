@@ -0,0 +1,29 @@
+#include "ulib.h"
+
+// free [pid ...]: print memory usage in KB, and resident memory of procs
+
+int
+main(int argc, char *argv[])
+{
+  struct meminfo mi;
+  int i, pid;
+
+  if(meminfo(0, &mi) < 0){
+    printf("free: meminfo failed\n");
+    exit(1);
+  }
+  printf("total %d KB, used %d KB, free %d KB\n",
+    mi.total * 4, (mi.total - mi.free) * 4, mi.free * 4);
+  printf("swap total %d KB, used %d KB\n", mi.swap_total * 4, mi.swap_used * 4);
+  printf("zeroed page hit %d, miss %d\n", mi.zero_hit, mi.zero_miss);
+  printf("same page merging saved %d KB\n", mi.ksm_saved * 4);
+  printf("huge pages mapped %d\n", mi.huge_alloc);
+  for(i = 1; i < argc; i++){
+    pid = atoi(argv[i]);
+    if(meminfo(pid, &mi) < 0)
+      printf("free: no proc %d\n", pid);
+    else
+      printf("pid %d: rss %d KB\n", pid, mi.rss * 4);
+  }
+  exit(0);
+}
@@ -19,27 +19,14 @@ fmtname(char *path)
   return buf;
 }
 
-int
-stat(const char *n, struct stat *st)
-{
-  int fd;
-  int r;
-
-  fd = open(n, O_RDONLY);
-  if(fd < 0)
-    return -1;
-  r = fstat(fd, st);
-  close(fd);
-  return r;
-}
+#define NDENTS 16
 
 void
 ls(char *path)
 {
-  char buf[512], *p;
-  int fd;
-  struct dirent de;
+  int fd, n, i;
   struct stat st;
+  struct dirent_stat des[NDENTS];
 
   if((fd = open(path, 0)) < 0){
     fprintf(2, "ls: cannot open %s\n", path);
@@ -59,24 +46,14 @@ ls(char *path)
     break;
 
   case TYPE_DIR:
-    if(strlen(path) + 1 + MAX_NAME + 1 > sizeof buf){
-      printf("ls: path too long\n");
-      break;
-    }
-    strcpy(buf, path);
-    p = buf+strlen(buf);
-    *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.node == 0)
-        continue;
-      memcpy(p, de.name, MAX_NAME);
-      p[MAX_NAME] = 0;
-      if(stat(buf, &st) < 0){
-        printf("ls: cannot stat %s\n", buf);
-        continue;
-      }
-      printf("%s %d %d %d\n", fmtname(buf), st.type, st.size, st.node);
+    // entries come with their stat, no open/fstat/close per entry
+    while((n = getdents(fd, des, NDENTS, GD_STAT)) > 0){
+      for(i = 0; i < n; i++)
+        printf("%s %d %d %d\n", fmtname(des[i].name),
+               des[i].st.type, des[i].st.size, des[i].st.node);
     }
+    if(n < 0)
+      printf("ls: cannot read %s\n", path);
     break;
   }
   close(fd);
@@ -0,0 +1,16 @@
+#include "ulib.h"
+
+// nice n command [args ...]: run command n levels lower in the scheduler
+
+int
+main(int argc, char *argv[])
+{
+  if(argc < 3){
+    fprintf(2, "usage: nice n command [args ...]\n");
+    exit(1);
+  }
+  nice(atoi(argv[1]));
+  exec(argv[2], argv + 2);
+  fprintf(2, "nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,24 @@
+#include "ulib.h"
+
+// rtstat [pid ...]: print scheduling class and deadline misses of procs
+
+int
+main(int argc, char *argv[])
+{
+  struct schedinfo si;
+  int i, pid;
+
+  for(i = 1; i < argc; i++){
+    pid = atoi(argv[i]);
+    if(schedinfo(pid, &si) < 0){
+      printf("rtstat: no proc %d\n", pid);
+      continue;
+    }
+    if(si.period == 0)
+      printf("pid %d: mlfq level %d, nice %d\n", pid, si.prio, si.nice);
+    else
+      printf("pid %d: edf period %d, runtime %d, deadline %d, jobs %d, miss %d\n",
+        pid, si.period, si.runtime, si.deadline, si.jobs, si.miss);
+  }
+  exit(0);
+}
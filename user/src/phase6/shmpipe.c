@@ -0,0 +1,62 @@
+#include "ulib.h"
+
+// shmpipe [n]: pass n chunks of 4 KiB from a producer to a consumer
+// through a ring in shared memory, no byte is copied by the kernel
+
+#define NSLOT 8
+#define CHUNK 4096
+#define N     256
+
+struct ring {
+  char slot[NSLOT][CHUNK];
+};
+
+int
+main(int argc, char *argv[])
+{
+  struct ring *ring;
+  int empty, full, n, i, j, pid;
+  uint32_t sum;
+
+  n = argc > 1 ? atoi(argv[1]) : N;
+  ring = shmat(0, sizeof(struct ring));
+  if(ring == MAP_FAILED){
+    printf("shmpipe: shmat failed\n");
+    exit(1);
+  }
+  empty = sem_open(NSLOT);
+  full = sem_open(0);
+  assert(empty >= 0 && full >= 0);
+
+  pid = fork();
+  if(pid < 0){
+    printf("shmpipe: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    // consumer
+    sum = 0;
+    for(i = 0; i < n; i++){
+      P(full);
+      for(j = 0; j < CHUNK; j++)
+        sum += (uint8_t)ring->slot[i % NSLOT][j];
+      V(empty);
+    }
+    printf("consumer: %d chunks, sum %d\n", n, sum);
+    exit(0);
+  }
+  // producer
+  sum = 0;
+  for(i = 0; i < n; i++){
+    P(empty);
+    for(j = 0; j < CHUNK; j++){
+      ring->slot[i % NSLOT][j] = (char)(i + j);
+      sum += (uint8_t)(i + j);
+    }
+    V(full);
+  }
+  wait(0);
+  printf("producer: %d chunks, sum %d\n", n, sum);
+  munmap(ring, sizeof(struct ring));
+  exit(0);
+}
@@ -16,12 +16,8 @@ void parse_arg(char *args, int argc, char *argv[]) {
 }
 
 void exec_another(char *file, char *argv[]) {
-    int r;
-    switch (r = fork()) {
-    case -1: fprintf(2, "xargs: fork failed\n"); exit(1);
-    case 0: exec(file, argv); fprintf(2, "xargs: exec failed\n"); exit(1);
-    default: wait(NULL);
-    }
+    if (spawn(file, argv, NULL) < 0) {fprintf(2, "xargs: exec failed\n"); return;}
+    wait(NULL);
 }
 
 void exec_by_args(char *args, char *file, int argc, char *argv[]) {
@@ -99,12 +99,12 @@ int unlink(const char *path) {
 
 // optional syscall
 
-void *mmap() {
-  return (void*)syscall(SYS_mmap, 0, 0, 0, 0, 0);
+void *mmap(int fd, uint32_t off, size_t len, int prot, int flags) {
+  return (void*)syscall(SYS_mmap, fd, off, len, prot, flags);
 }
 
-void munmap(void *addr) {
-  syscall(SYS_munmap, (size_t)addr, 0, 0, 0, 0);
+int munmap(void *addr, size_t len) {
+  return (int)syscall(SYS_munmap, (size_t)addr, len, 0, 0, 0);
 }
 
 int clone(void (*entry)(void*), void *stack, void *arg) {
@@ -146,3 +146,49 @@ int link(const char *oldpath, const char *newpath) {
 int symlink(const char *oldpath, const char *newpath) {
   return (int)syscall(SYS_symlink, (size_t)oldpath, (size_t)newpath, 0, 0, 0);
 }
+
+// extended syscall
+
+int getdents(int fd, struct dirent_stat *buf, int count, int flags) {
+  return (int)syscall(SYS_getdents, (size_t)fd, (size_t)buf, (size_t)count, (size_t)flags, 0);
+}
+
+int sendfile(int out_fd, int in_fd, uint32_t count) {
+  return (int)syscall(SYS_sendfile, (size_t)out_fd, (size_t)in_fd, (size_t)count, 0, 0);
+}
+
+int readv(int fd, const struct iovec *iov, int iovcnt) {
+  return (int)syscall(SYS_readv, (size_t)fd, (size_t)iov, (size_t)iovcnt, 0, 0);
+}
+
+int writev(int fd, const struct iovec *iov, int iovcnt) {
+  return (int)syscall(SYS_writev, (size_t)fd, (size_t)iov, (size_t)iovcnt, 0, 0);
+}
+
+int spawn(const char *path, char *const argv[], const struct spawn_action *acts) {
+  return (int)syscall(SYS_spawn, (size_t)path, (size_t)argv, (size_t)acts, 0, 0);
+}
+
+int meminfo(int pid, struct meminfo *mi) {
+  return (int)syscall(SYS_meminfo, (size_t)pid, (size_t)mi, 0, 0, 0);
+}
+
+void *shmat(const char *name, size_t len) {
+  return (void*)syscall(SYS_shmat, (size_t)name, len, 0, 0, 0);
+}
+
+int nice(int inc) {
+  return (int)syscall(SYS_nice, inc, 0, 0, 0, 0);
+}
+
+int sched_rt(uint32_t period, uint32_t runtime, uint32_t deadline) {
+  return (int)syscall(SYS_sched_rt, period, runtime, deadline, 0, 0);
+}
+
+int schedinfo(int pid, struct schedinfo *si) {
+  return (int)syscall(SYS_schedinfo, (size_t)pid, (size_t)si, 0, 0, 0);
+}
+
+int sem_p_timeout(int sem_id, int ticks) {
+  return (int)syscall(SYS_sem_p_timeout, (size_t)sem_id, (size_t)ticks, 0, 0, 0);
+}
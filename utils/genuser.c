@@ -5,9 +5,28 @@
 #include <libgen.h>
 #include <assert.h>
 
-#define MAX_NAME (31 - 2 * sizeof(uint32_t))
-#define SECTSIZE 512
-#define MAX_FILE (SECTSIZE / sizeof(inode_t))
+// Layout (relative to user.img):
+// [ header | dinode table (DIR_SECT) | name hash (HASH_SECT) | file data | swap ]
+// must be the same as EASY_FS in kernel/src/fs.c
+
+#define MAX_NAME   (31 - 2 * sizeof(uint32_t))
+#define SECTSIZE   512
+#define IMG_START  256 // user.img start from 256th sect
+#define EASY_MAGIC 0x59534145
+#define MAX_FILE   512
+#define HASH_SIZE  1024
+#define DIR_SECT   (MAX_FILE * sizeof(inode_t) / SECTSIZE)
+#define HASH_SECT  (HASH_SIZE * sizeof(uint16_t) / SECTSIZE)
+#define SWAP_PAGES 4096 // 16 MiB swap area after file data
+#define PGSECT     8    // sectors per page
+
+typedef struct {
+  uint32_t magic;
+  uint32_t nfile;
+  uint32_t hash_size;
+  uint32_t swap_start; // first sector of swap area
+  uint32_t swap_pages; // pages of swap area
+} header_t;
 
 typedef struct {
   uint32_t start_sect;
@@ -16,15 +35,44 @@ typedef struct {
 } inode_t;
 
 inode_t inode[MAX_FILE];
+uint16_t name_hash[HASH_SIZE];
 
-int file_num = 0, curr_sect = 257;
+int file_num = 0, curr_sect = IMG_START + 1 + DIR_SECT + HASH_SECT;
 FILE *disk;
 char buf[SECTSIZE];
 
+// FNV-1a, must match kernel/src/fs.c
+uint32_t name_hashfn(const char *name) {
+  uint32_t h = 2166136261u;
+  for (; *name; ++name) {
+    h = (h ^ (uint8_t)*name) * 16777619u;
+  }
+  return h;
+}
+
+void add_hash(int no) {
+  uint32_t h = name_hashfn(inode[no].name);
+  for (int i = 0; i < HASH_SIZE; ++i) {
+    uint16_t *slot = &name_hash[(h + i) & (HASH_SIZE - 1)];
+    if (*slot == 0) {
+      *slot = no + 1;
+      return;
+    }
+    if (strcmp(inode[*slot - 1].name, inode[no].name) == 0) {
+      fprintf(stderr, "duplicate file name %s\n", inode[no].name);
+      exit(1);
+    }
+  }
+  assert(0);
+}
+
 void add_file(char *name) {
   FILE *fp = fopen(name, "r");
   assert(fp);
-  assert(file_num < MAX_FILE);
+  if (file_num >= MAX_FILE) {
+    fprintf(stderr, "too many files, at most %d\n", MAX_FILE);
+    exit(1);
+  }
   char *bsname = basename(name);
   assert(strlen(bsname) <= MAX_NAME);
   inode[file_num].start_sect = curr_sect;
@@ -33,6 +81,7 @@ void add_file(char *name) {
   uint32_t length = inode[file_num].length = ftell(fp);
   curr_sect += (length + SECTSIZE - 1) / SECTSIZE;
   fseek(fp, 0, SEEK_SET);
+  add_hash(file_num);
   ++file_num;
   size_t rdbytes;
   while ((rdbytes = fread(buf, 1, SECTSIZE, fp)) > 0) {
@@ -45,18 +94,30 @@ void add_file(char *name) {
 }
 
 void write_inode() {
+  static_assert(SECTSIZE % sizeof(inode_t) == 0, "inode must not cross sector");
+  static_assert(sizeof(header_t) <= SECTSIZE, "header must fit in a sector");
+  header_t header = {EASY_MAGIC, file_num, HASH_SIZE, curr_sect, SWAP_PAGES};
   fseek(disk, 0, SEEK_SET);
-  fwrite(inode, 1, SECTSIZE, disk);
+  fwrite(&header, 1, sizeof(header), disk);
+  fseek(disk, SECTSIZE, SEEK_SET);
+  fwrite(inode, 1, DIR_SECT * SECTSIZE, disk);
+  fwrite(name_hash, 1, HASH_SECT * SECTSIZE, disk);
 }
 
 int main(int argc, char *argv[]) {
   assert(argc > 2);
   disk = fopen(argv[1], "w");
   assert(disk);
-  fwrite(buf, SECTSIZE, 1, disk);
+  // reserve header, dinode table and name hash, fill them at last
+  for (int i = IMG_START; i < IMG_START + 1 + DIR_SECT + HASH_SECT; ++i) {
+    fwrite(buf, SECTSIZE, 1, disk);
+  }
   for (int i = 2; i < argc; ++i) {
     add_file(argv[i]);
   }
+  // extend the img to hold swap area, leave it as a hole
+  fseek(disk, (curr_sect + SWAP_PAGES * PGSECT - IMG_START) * SECTSIZE - 1, SEEK_SET);
+  fputc(0, disk);
   write_inode();
   fclose(disk);
   return 0;
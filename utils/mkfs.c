@@ -20,10 +20,10 @@ void panic(const char *msg) {
 #define TODO() panic("implement me")
 
 // Disk layout:
-//         [ boot.img | kernel.img |                      user.img                      ]
-//         [   mbr    |   kernel   | super block | bit map | inode blocks | data blocks ]
-// sect    0          1          256           264       272            512        262144
-// block   0                      32            33        34             64         32768
+//         [ boot.img | kernel.img |                      user.img                             ]
+//         [   mbr    |   kernel   | super block | bit map | inode blocks | data blocks | swap  ]
+// sect    0          1          256           264       272            512        229376  262144
+// block   0                      32            33        34             64         28672   32768
 // YOUR TASK: build user.img
 
 #define DISK_SIZE (128 * 1024 * 1024) // disk is 128 MiB
@@ -37,6 +37,8 @@ void panic(const char *msg) {
 #define BITMAP_BLK  (BLK_OFF + 1)  // block no of bitmap
 #define INODE_START (BLK_OFF + 2)  // start block no of inode blocks
 #define DATA_START  (BLK_OFF + 32) // start block no of data blocks
+#define SWAP_NUM    4096           // blocks of swap area, at the end of disk
+#define SWAP_START  (BLK_NUM - SWAP_NUM) // start block no of swap area
 
 #define IPERBLK   (BLK_SIZE / sizeof(dinode_t)) // inode num per blk
 #define INODE_NUM ((DATA_START - INODE_START) * IPERBLK)
@@ -64,6 +66,8 @@ typedef struct {
   uint32_t istart; // start block no of inode blocks
   uint32_t inum;   // total inode num
   uint32_t root;   // inode no of root dir
+  uint32_t swap_start; // start block no of swap area
+  uint32_t swap_num;   // blocks of swap area, one page each
 } sb_t;
 
 // on-disk inode
@@ -130,9 +134,15 @@ void init_disk() {
   sb->bitmap = BITMAP_BLK;
   sb->istart = INODE_START;
   sb->inum = INODE_NUM;
+  sb->swap_start = SWAP_START;
+  sb->swap_num = SWAP_NUM;
   bitmap = bget(BITMAP_BLK);
   // mark first 64 blocks used
   bitmap->u32buf[0] = bitmap->u32buf[1] = 0xffffffff;
+  // mark swap area used, it is not for files
+  for (uint32_t i = SWAP_START; i < BLK_NUM; i++) {
+    bitmap->u8buf[i / 8] |= (1 << (i % 8));
+  }
   // alloc and init root inode
   sb->root = ialloc(TYPE_DIR);
   root = iget(sb->root);
@@ -148,7 +158,7 @@ void init_disk() {
 uint32_t balloc() {
   // alloc a unused block, mark it on bitmap, then return its no
   static uint32_t next_blk = 64;
-  if (next_blk >= BLK_NUM) panic("no more block");
+  if (next_blk >= SWAP_START) panic("no more block");
   bitmap->u8buf[next_blk / 8] |= (1 << (next_blk % 8));
   return next_blk++;
 }